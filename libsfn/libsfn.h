@@ -183,6 +183,8 @@ typedef struct {
     long int total;
     uint16_t *p;
     int np, ap, mx, my, lx, ly;
+    uint16_t *e;                /* private, edge lists used by sfn_glyph() */
+    int ae;
 } sfnctx_t;
 /**
  * The global font context
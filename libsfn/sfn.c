@@ -545,6 +545,8 @@ void sfn_free()
     if(ctx.license) free(ctx.license);
     for(i = 0; i < 0x110000; i++)
         sfn_chardel(i);
+    if(ctx.p) free(ctx.p);
+    if(ctx.e) free(ctx.e);
     memset(&ctx, 0, sizeof(ctx));
 }
 
@@ -2312,6 +2314,24 @@ static void _sfn_b(int p,int h, int x0,int y0, int x1,int y1, int x2,int y2, int
     if(l) _sfn_l(p,h, x3, y3);
 }
 
+/**
+ * Sort edges by their first scanline in k (heap sort)
+ */
+static void _sfn_es(uint16_t *e, uint16_t *k, int n)
+{
+    int i, j, m, r;
+    uint16_t t;
+    for(m = n, i = n / 2; m > 1;) {
+        if(i > 0) r = --i;
+        else { m--; t = e[0]; e[0] = e[m]; e[m] = t; t = k[0]; k[0] = k[m]; k[m] = t; r = 0; }
+        for(; (j = 2 * r + 1) < m; r = j) {
+            if(j + 1 < m && k[j + 1] > k[j]) j++;
+            if(k[r] >= k[j]) break;
+            t = e[r]; e[r] = e[j]; e[j] = t; t = k[r]; k[r] = k[j]; k[j] = t;
+        }
+    }
+}
+
 /**
  * Rasterize a layer or glyph
  *
@@ -2324,8 +2344,8 @@ static void _sfn_b(int p,int h, int x0,int y0, int x1,int y1, int x2,int y2, int
 int sfn_glyph(int size, int unicode, int layer, int postproc, sfngc_t *g)
 {
     uint8_t ci = 0, cb = 0;
-    uint16_t r[640];
-    int i, j, k, l, p, m, n, o, w, h, a, A, b, B, nr, x;
+    uint16_t *ee, *ea, *ex;
+    int i, j, k, l, p, m, n, o, w, h, a, A, b, B, nr, ne, na, x;
     sfncont_t *cont;
 
     if(unicode < 0 || unicode > 0x10FFFF || !ctx.glyphs[unicode].numlayer || layer >= ctx.glyphs[unicode].numlayer ||
@@ -2366,37 +2386,54 @@ int sfn_glyph(int size, int unicode, int layer, int postproc, sfngc_t *g)
                         }
                 }
                 if(ctx.mx != ctx.lx || ctx.my != ctx.ly) _sfn_l(p << SSFN_PREC, h << SSFN_PREC, ctx.mx, ctx.my);
+                if(ctx.np > 4 && ctx.ae < ctx.np) {
+                    ctx.ae = ctx.np;
+                    ctx.e = (uint16_t*)realloc(ctx.e, ctx.ae * sizeof(uint16_t));
+                    if(!ctx.e) ctx.ae = ctx.np = 0;
+                }
                 if(ctx.np > 4) {
-                    for(b = A = B = o = 0; b < h; b++, B += p) {
+                    /* edges which cross at least one scanline, sorted by their first scanline. The active edge
+                     * list never gets longer than the number of edges already taken, so it can reuse the same array */
+                    ee = ea = ctx.e; ex = ee + ctx.np / 2;
+                    for(ne = i = 0; i < ctx.np - 3; i += 2)
+                        if((ctx.p[i+1] >> SSFN_PREC) != (ctx.p[i+3] >> SSFN_PREC)) {
+                            ee[ne] = i;
+                            ex[ne++] = ((ctx.p[i+1] < ctx.p[i+3] ? ctx.p[i+1] : ctx.p[i+3]) >> SSFN_PREC) + 1;
+                        }
+                    _sfn_es(ee, ex, ne);
+                    /* walk the scanlines with an active edge list, kept sorted by the crossing x coordinates */
+                    for(b = A = B = o = na = j = 0; b < h; b++, B += p) {
                         a = b << SSFN_PREC;
-                        for(nr = 0, i = 0; i < ctx.np - 3; i += 2) {
-                            if( (ctx.p[i+1] < a && ctx.p[i+3] >= a) ||
-                                (ctx.p[i+3] < a && ctx.p[i+1] >= a)) {
-                                    if((ctx.p[i+1] >> SSFN_PREC) == (ctx.p[i+3] >> SSFN_PREC))
-                                        x = (((int)ctx.p[i]+(int)ctx.p[i+2])>>1);
-                                    else
-                                        x = ((int)ctx.p[i]) + ((a - (int)ctx.p[i+1])*
-                                            ((int)ctx.p[i+2] - (int)ctx.p[i])/
-                                            ((int)ctx.p[i+3] - (int)ctx.p[i+1]));
-                                    x >>= SSFN_PREC;
-                                    if(ci) x += (h - b) / SSFN_ITALIC_DIV;
-                                    if(cb && !o) {
-                                        if(g->data[B + x] == 0xFF) { o = -cb; A = cb; }
-                                        else { o = cb; A = -cb; }
-                                    }
-                                    for(k = 0; k < nr && x > r[k]; k++);
-                                    for(l = nr; l > k; l--) r[l] = r[l-1];
-                                    r[k] = x;
-                                    nr++;
-                            }
+                        for(; j < ne && (((ctx.p[ee[j]+1] < ctx.p[ee[j]+3] ? ctx.p[ee[j]+1] : ctx.p[ee[j]+3]) >>
+                            SSFN_PREC) + 1) <= b; j++) ea[na++] = ee[j];
+                        for(nr = i = 0; i < na; i++) {
+                            l = ea[i];
+                            if(ctx.p[l+1] < a && ctx.p[l+3] < a) continue;
+                            x = ((int)ctx.p[l]) + ((a - (int)ctx.p[l+1])*
+                                ((int)ctx.p[l+2] - (int)ctx.p[l])/
+                                ((int)ctx.p[l+3] - (int)ctx.p[l+1]));
+                            x >>= SSFN_PREC;
+                            if(ci) x += (h - b) / SSFN_ITALIC_DIV;
+                            /* edges rarely swap between scanlines, so this insertion is almost linear */
+                            for(k = nr; k > 0 && ex[k-1] > x; k--) { ea[k] = ea[k-1]; ex[k] = ex[k-1]; }
+                            ea[k] = l; ex[k] = x;
+                            nr++;
+                        }
+                        na = nr;
+                        if(cb && !o && nr) {
+                            /* bold direction is decided by the first edge of the path crossing a scanline */
+                            for(k = 0, i = 1; i < nr; i++)
+                                if(ea[i] < ea[k]) k = i;
+                            if(g->data[B + ex[k]] == 0xFF) { o = -cb; A = cb; }
+                            else { o = cb; A = -cb; }
                         }
-                        if(nr > 1 && nr & 1) { r[nr - 2] = r[nr - 1]; nr--; }
+                        if(nr > 1 && nr & 1) { ex[nr - 2] = ex[nr - 1]; nr--; }
                         if(nr) {
                             for(i = 0; i < nr - 1; i += 2) {
-                                l = r[i] + o; m = r[i + 1] + A;
+                                l = ex[i] + o; m = ex[i + 1] + A;
                                 if(l < 0) l = 0;
                                 if(m > p) m = p;
-                                if(i > 0 && l < r[i - 1] + A) l = r[i - 1] + A;
+                                if(i > 0 && l < ex[i - 1] + A) l = ex[i - 1] + A;
                                 for(; l < m; l++)
                                     g->data[B + l] = g->data[B + l] == ctx.glyphs[unicode].layers[n].color ?
                                         0xFF : ctx.glyphs[unicode].layers[n].color;
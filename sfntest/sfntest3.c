@@ -68,6 +68,7 @@ void do_test(SDL_Surface *screen, char *fontfn, int argc)
 
     /* initialize the normal renderer */
     memset(&ctx, 0, sizeof(ssfn_t));
+    memset(&buf, 0, sizeof(ssfn_buf_t));
     buf.ptr = (uint8_t*)screen->pixels;
     buf.p = screen->pitch;
     buf.w = screen->w;
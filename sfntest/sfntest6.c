@@ -29,7 +29,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #define SSFN_IMPLEMENTATION
+#define SSFN_LOADFILE
 #include "../ssfn.h"
 
 /**
@@ -61,14 +63,21 @@ void do_test(char *fontfn, int argc)
 {
     /* start test string with "f", because in FreeSerifI.sfn it has a tail that overlaps with the prev glyph */
     /* end with "F" because when italic is calculated, it has a top right pixel */
-    char *s, *str0 = "f Checking the Bounding Box F";
-    int ret, size, l, t, w, h;
+    char *s, *str0 = "f Checking the Bounding Box F", tmp[128];
+    /* a paragraph to wrap, with a tab, which isn't in most fonts */
+    char *str1 = "The quick brown\tfox jumps over the lazy dog, in a well-known pangram that has every letter.";
+    int ret, size, l, t, w, h, i, j, n;
+    uint8_t *mask, *pix;
     ssfn_t ctx;
     ssfn_font_t *font;
     ssfn_buf_t buf;
+    ssfn_line_t lines[16];
+    ssfn_metrics_t m;
+    ssfn_gpos_t run[64];
 
     /* initialize the normal renderer */
     memset(&ctx, 0, sizeof(ssfn_t));
+    memset(&buf, 0, sizeof(ssfn_buf_t));
     buf.p = 4096;
     buf.w = 1024;
     buf.h = 768;
@@ -185,17 +194,160 @@ void do_test(char *fontfn, int argc)
         s += ret;
     if(ret != SSFN_OK) { fprintf(stderr, "ssfn render error: err=%d %s\n", ret, ssfn_error(ret)); free(buf.ptr); exit(2); }
 
+    /* size 192 without anti-aliasing, taller than 255 pixels with this font. The second glyph comes from the cache,
+     * and must look the same as the first one */
+    memset(buf.ptr, 0xF8, buf.p * buf.h);
+    buf.y = 300;
+    ret = ssfn_select(&ctx, SSFN_FAMILY_ANY, NULL, SSFN_STYLE_NOAA, 192);
+    if(ret != SSFN_OK) { fprintf(stderr, "ssfn select error: err=%d %s\n", ret, ssfn_error(ret)); free(buf.ptr); exit(2); }
+    buf.x = 30;
+    ret = ssfn_render(&ctx, &buf, "l");
+    l = buf.x;
+    if(ret > 0) ret = ssfn_render(&ctx, &buf, "l");
+    if(ret < 0) { fprintf(stderr, "ssfn render error: err=%d %s\n", ret, ssfn_error(ret)); free(buf.ptr); exit(2); }
+    for(h = 0; h < buf.h && !memcmp(buf.ptr + h * buf.p + 30 * 4, buf.ptr + h * buf.p + l * 4, (l - 30) * 4); h++);
+    printf("cached glyph %s\n", h == buf.h ? "matches" : "differs");
+
+    /* wrapped lines must be just as wide and tall as ssfn_bbox() measures them (with the tab as a space), except for
+     * the left margin, which ssfn_bbox() adds to the width */
+    ret = ssfn_select(&ctx, SSFN_FAMILY_ANY, NULL, SSFN_STYLE_REGULAR, 16);
+    if(ret != SSFN_OK) { fprintf(stderr, "ssfn select error: err=%d %s\n", ret, ssfn_error(ret)); free(buf.ptr); exit(2); }
+    n = ssfn_wrap(&ctx, str1, 128, lines, 16);
+    if(n < 1 || n > 16) { fprintf(stderr, "ssfn wrap error: err=%d %s\n", n, ssfn_error(n)); free(buf.ptr); exit(2); }
+    for(i = 0; i < n; i++) {
+        for(j = 0; j < lines[i].len; j++) tmp[j] = str1[lines[i].offs + j] == '\t' ? ' ' : str1[lines[i].offs + j];
+        tmp[j] = 0;
+        ssfn_bbox(&ctx, tmp, &w, &h, &l, &t);
+        if(w - l != lines[i].w || h != lines[i].h || t != lines[i].top) break;
+    }
+    /* and drawing a line must move the pen by its width */
+    buf.x = 30; buf.y = 700;
+    ret = ssfn_render_str(&ctx, &buf, str1 + lines[0].offs, lines[0].len, 0);
+    if(ret < 0) { fprintf(stderr, "ssfn render error: err=%d %s\n", ret, ssfn_error(ret)); free(buf.ptr); exit(2); }
+    printf("wrapped %d lines, sizes %s\n", n, i == n && buf.x - 30 == lines[0].w ? "match" : "differ");
+
+    /* an alpha mask must have the coverage that ssfn_render() blends with, so a white glyph drawn on transparent black
+     * has the mask in its alpha channel (ssfn_render() skips pixels with an alpha of 15 or less) */
+    ret = ssfn_select(&ctx, SSFN_FAMILY_ANY, NULL, SSFN_STYLE_ITALIC, 24);
+    if(ret != SSFN_OK) { fprintf(stderr, "ssfn select error: err=%d %s\n", ret, ssfn_error(ret)); free(buf.ptr); exit(2); }
+    buf.fg = 0xFFFFFFFF;
+    for(s = str0, n = j = 0; *s; s += ret, n++) {
+        ret = ssfn_render_mask(&ctx, s, NULL, NULL, 0, &m);
+        if(ret < 1) { fprintf(stderr, "ssfn render error: err=%d %s\n", ret, ssfn_error(ret)); free(buf.ptr); exit(2); }
+        if(!m.w || !m.h) continue;
+        mask = (uint8_t*)malloc(m.w * m.h);
+        if(!mask) { fprintf(stderr, "memory allocation error\n"); free(buf.ptr); exit(2); }
+        ssfn_render_mask(&ctx, s, mask, NULL, m.w, &m);
+        memset(buf.ptr, 0, buf.p * buf.h);
+        buf.x = 100; buf.y = 100;
+        ssfn_render(&ctx, &buf, s);
+        for(i = 0; i < m.w * m.h; i++)
+            if(buf.ptr[(100 - m.top + i / m.w) * buf.p + (100 - m.left + i % m.w) * 4 + 3] != (mask[i] > 15 ? mask[i] : 0))
+                j++;
+        free(mask);
+    }
+    printf("masked %d glyphs, masks %s\n", n, j ? "differ" : "match");
+
+    /* a laid out run must draw the same pixels as rendering its glyphs one by one, also with subpixel positions */
+    pix = (uint8_t*)malloc(buf.p * buf.h);
+    if(!pix) { fprintf(stderr, "memory allocation error\n"); free(buf.ptr); exit(2); }
+    buf.fg = 0xFF202020;
+    for(i = j = 0; i < 2; i++) {
+        ret = ssfn_select(&ctx, SSFN_FAMILY_ANY, NULL, i ? SSFN_STYLE_SUBPIXEL : SSFN_STYLE_REGULAR, 24);
+        if(ret != SSFN_OK) { fprintf(stderr, "ssfn select error: err=%d %s\n", ret, ssfn_error(ret)); free(buf.ptr); exit(2); }
+        memset(buf.ptr, 0xF8, buf.p * buf.h);
+        buf.x = 30; buf.y = 100; buf.fx = 0;
+        for(s = str0; (ret = ssfn_render(&ctx, &buf, s)) > 0; s += ret);
+        if(ret != SSFN_OK) { fprintf(stderr, "ssfn render error: err=%d %s\n", ret, ssfn_error(ret)); free(buf.ptr); exit(2); }
+        memcpy(pix, buf.ptr, buf.p * buf.h);
+        n = ssfn_layout(&ctx, str0, -1, run, 64);
+        if(n < 1 || n > 64) { fprintf(stderr, "ssfn layout error: err=%d %s\n", n, ssfn_error(n)); free(buf.ptr); exit(2); }
+        memset(buf.ptr, 0xF8, buf.p * buf.h);
+        buf.x = 30; buf.y = 100; buf.fx = 0;
+        ret = ssfn_render_layout(&ctx, &buf, run, n);
+        if(ret != SSFN_OK) { fprintf(stderr, "ssfn render error: err=%d %s\n", ret, ssfn_error(ret)); free(buf.ptr); exit(2); }
+        if(memcmp(pix, buf.ptr, buf.p * buf.h)) j++;
+    }
+    free(pix);
+    printf("laid out %d glyphs, pixels %s\n", n, j ? "differ" : "match");
+
+    /* with a budget, the glyph cache must never grow bigger than that, however many glyphs are rendered */
+    ssfn_cachelimit(&ctx, 65536);
+    for(i = 16, j = 0; i <= 64; i += 8) {
+        ret = ssfn_select(&ctx, SSFN_FAMILY_ANY, NULL, SSFN_STYLE_REGULAR, i);
+        if(ret != SSFN_OK) { fprintf(stderr, "ssfn select error: err=%d %s\n", ret, ssfn_error(ret)); free(buf.ptr); exit(2); }
+        buf.x = 30; buf.y = 100;
+        for(s = str0; (ret = ssfn_render(&ctx, &buf, s)) > 0; s += ret)
+            if(ctx.cachesize > 65536) j++;
+        if(ret != SSFN_OK) { fprintf(stderr, "ssfn render error: err=%d %s\n", ret, ssfn_error(ret)); free(buf.ptr); exit(2); }
+    }
+    printf("evicted %d glyphs, cache %s the budget\n", (int)ctx.evictions, j ? "over" : "within");
+    ssfn_cachelimit(&ctx, 0);
+
     printf("Memory allocated: %d\n", ssfn_mem(&ctx));
     ssfn_free(&ctx);
     free(font);
     free(buf.ptr);
 }
 
+/**
+ * testing that ssfn_load_file() works just like ssfn_load() with the bundled fonts
+ */
+void do_test_files(void)
+{
+    char *fonts[] = { "FreeSans.sfn", "FreeSansB.sfn", "FreeSansI.sfn", "FreeSerif.sfn", "FreeSerifB.sfn",
+        "FreeSerifI.sfn", "Vera.sfn", "VeraB.sfn", "VeraBI.sfn", "VeraI.sfn", "VeraR.sfn", "bende.sfn", "chrome.sfn",
+        "creep.sfn.gz", "emoji.sfn", "lanapixel.sfn.gz", "stoneage.sfn", "u_vga16.sfn.gz", "unifont.sfn.gz", NULL };
+    char *s, *str0 = "Hello, World! 0123456789", fn[64];
+    int ret[2], size, i, j, k, n;
+    uint8_t *pix;
+    ssfn_t ctx[2];
+    ssfn_font_t *font;
+    ssfn_buf_t buf;
+
+    memset(&buf, 0, sizeof(ssfn_buf_t));
+    buf.p = 4096;
+    buf.w = 1024;
+    buf.h = 128;
+    buf.fg = 0xFF202020;
+    buf.ptr = (uint8_t*)malloc(buf.p * buf.h);
+    pix = (uint8_t*)malloc(buf.p * buf.h);
+    if(!buf.ptr || !pix) { fprintf(stderr, "unable to allocate off-screen buffer\r\n"); exit(1); }
+
+    for(i = n = 0; fonts[i]; i++) {
+        sprintf(fn, "../fonts/%s", fonts[i]);
+        font = load_file(fn, &size);
+        memset(&ctx, 0, sizeof(ctx));
+        ret[0] = ssfn_load_file(&ctx[0], fn);
+        ret[1] = ssfn_load(&ctx[1], font);
+        k = ret[0] != ret[1];
+        if(!k && ret[0] == SSFN_OK) {
+            /* draw the same string with both, whatever glyphs the font has */
+            for(j = 0; j < 2; j++) {
+                memset(buf.ptr, 0xF8, buf.p * buf.h);
+                buf.x = 30; buf.y = 64;
+                ret[j] = ssfn_select(&ctx[j], SSFN_FAMILY_ANY, NULL, SSFN_STYLE_REGULAR, 32);
+                for(s = str0; ret[j] == SSFN_OK && (ret[j] = ssfn_render(&ctx[j], &buf, s)) > 0; s += ret[j]);
+                if(!j) memcpy(pix, buf.ptr, buf.p * buf.h);
+            }
+            k = ret[0] != ret[1] || memcmp(buf.ptr, pix, buf.p * buf.h);
+        }
+        if(k) { printf("%s differs\n", fonts[i]); n++; }
+        ssfn_free(&ctx[0]);
+        ssfn_free(&ctx[1]);
+        free(font);
+    }
+    printf("loaded %d font files, %d differ\n", i, n);
+    free(pix);
+    free(buf.ptr);
+}
+
 /**
  * Main procedure
  */
 int main(int argc __attribute__((unused)), char **argv)
 {
     do_test(argv[1], argc);
+    do_test_files();
     return 0;
 }
@@ -72,6 +72,7 @@ void do_test(SDL_Surface *screen, char *fontfn)
     int x,y;
 
     /* initialize the normal renderer */
+    memset(&buf, 0, sizeof(ssfn_buf_t));
     buf.ptr = (uint8_t*)screen->pixels;
     buf.p = screen->pitch;
     buf.w = screen->w;
@@ -0,0 +1,182 @@
+/*
+ * sfntest8.c
+ *
+ * Copyright (C) 2020 bzt (bztsrc@gitlab)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * @brief testing Scalable Screen Font pixel formats
+ *
+ */
+
+#include <stdio.h>
+#define SSFN_IMPLEMENTATION
+#include "../ssfn.h"
+
+#include <SDL.h>
+
+#define W 760
+#define H 48
+
+/**
+ * Load a font
+ */
+ssfn_font_t *load_file(char *filename, int *size)
+{
+    char *fontdata = NULL;
+    FILE *f;
+
+    f = fopen(filename, "rb");
+    if(!f) { fprintf(stderr,"unable to load %s\n", filename); exit(3); }
+    *size = 0;
+    fseek(f, 0, SEEK_END);
+    *size = (int)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if(!*size) { fprintf(stderr,"unable to load %s\n", filename); exit(3); }
+    fontdata = (char*)malloc(*size);
+    if(!fontdata) { fprintf(stderr,"memory allocation error\n"); exit(2); }
+    fread(fontdata, *size, 1, f);
+    fclose(f);
+    return (ssfn_font_t*)fontdata;
+}
+
+/**
+ * Render a string into an off-screen buffer of the given format, then convert it to the screen's ARGB
+ */
+void do_format(ssfn_t *ctx, SDL_Surface *screen, int y, int fmt, int abgr, char *str)
+{
+    static uint8_t pixels[W * H * 4];
+    ssfn_buf_t buf;
+    uint32_t *d, c, r, g, b, a;
+    uint8_t *p;
+    int i, j, ret, bp = fmt == SSFN_PIXFMT_RGB565 ? 2 : (fmt == SSFN_PIXFMT_GRAY8 ? 1 : 4);
+
+    /* clear to the screen's background, premultiplied buffers start fully transparent */
+    for(p = pixels, i = 0; i < W * H; i++, p += bp)
+        switch(fmt) {
+            case SSFN_PIXFMT_BGRA: *((uint32_t*)p) = 0xF8F8F8FF; break;
+            case SSFN_PIXFMT_ARGB_PRE: *((uint32_t*)p) = 0; break;
+            case SSFN_PIXFMT_RGB565: *((uint16_t*)p) = 0xFFDF; break;
+            case SSFN_PIXFMT_GRAY8: *p = 0xF8; break;
+            default: *((uint32_t*)p) = 0xFFF8F8F8; break;
+        }
+
+    /* the buffer descriptor must be zerod out, so that fields not set here get their defaults */
+    memset(&buf, 0, sizeof(ssfn_buf_t));
+    buf.ptr = pixels;
+    buf.p = W * bp;
+    buf.w = abgr ? -W : W;
+    buf.h = H;
+    buf.f = fmt;
+    buf.fg = 0xFF2060C0;
+    buf.x = 8; buf.y = 36;
+    while((ret = ssfn_render(ctx, &buf, str)) > 0)
+        str += ret;
+    if(ret != SSFN_OK) { fprintf(stderr, "ssfn render error: err=%d %s\n", ret, ssfn_error(ret)); exit(2); }
+
+    for(j = 0; j < H; j++) {
+        d = (uint32_t*)((uint8_t*)screen->pixels + (y + j) * screen->pitch) + 20;
+        for(p = pixels + j * W * bp, i = 0; i < W; i++, p += bp) {
+            switch(fmt) {
+                case SSFN_PIXFMT_BGRA:
+                    c = *((uint32_t*)p); b = c >> 24; g = (c >> 16) & 0xFF; r = (c >> 8) & 0xFF; a = c & 0xFF;
+                break;
+                case SSFN_PIXFMT_ARGB_PRE:
+                    /* composite over the screen's background */
+                    c = *((uint32_t*)p); a = c >> 24;
+                    r = ((c >> 16) & 0xFF) + 0xF8 * (255 - a) / 255;
+                    g = ((c >> 8) & 0xFF) + 0xF8 * (255 - a) / 255;
+                    b = (c & 0xFF) + 0xF8 * (255 - a) / 255;
+                    a = 0xFF;
+                break;
+                case SSFN_PIXFMT_RGB565:
+                    c = *((uint16_t*)p); r = (c >> 11) << 3; g = ((c >> 5) & 0x3F) << 2; b = (c & 0x1F) << 3; a = 0xFF;
+                break;
+                case SSFN_PIXFMT_GRAY8: r = g = b = *p; a = 0xFF; break;
+                default:
+                    c = *((uint32_t*)p); a = c >> 24; r = (c >> 16) & 0xFF; g = (c >> 8) & 0xFF; b = c & 0xFF;
+                    if(abgr) { c = r; r = b; b = c; }
+                break;
+            }
+            d[i] = (a << 24) | (r << 16) | (g << 8) | b;
+        }
+    }
+}
+
+/**
+ * testing the SSFN library (normal renderer)
+ */
+void do_test(SDL_Surface *screen, char *fontfn)
+{
+    int ret, size;
+    ssfn_t ctx;
+    ssfn_font_t *font;
+
+    /* initialize the normal renderer */
+    memset(&ctx, 0, sizeof(ssfn_t));
+
+    /* load and select a font */
+    font = load_file(fontfn ? fontfn : (char*)"../fonts/FreeSerif.sfn", &size);
+    ret = ssfn_load(&ctx, font);
+    if(ret != SSFN_OK) { fprintf(stderr, "ssfn load error: err=%d %s\n", ret, ssfn_error(ret)); exit(2); }
+    /* without SSFN_STYLE_PIXFMT the buffer is always 32 bit ARGB (or ABGR), no matter buf.f */
+    ret = ssfn_select(&ctx, SSFN_FAMILY_ANY, NULL, SSFN_STYLE_REGULAR | SSFN_STYLE_PIXFMT, 32);
+    if(ret != SSFN_OK) { fprintf(stderr, "ssfn select error: err=%d %s\n", ret, ssfn_error(ret)); exit(2); }
+
+    do_format(&ctx, screen, 10, SSFN_PIXFMT_ARGB, 0, "SSFN_PIXFMT_ARGB (default)");
+    do_format(&ctx, screen, 70, SSFN_PIXFMT_ARGB, 1, "SSFN_PIXFMT_ARGB with negative width (ABGR)");
+    do_format(&ctx, screen, 130, SSFN_PIXFMT_BGRA, 0, "SSFN_PIXFMT_BGRA");
+    do_format(&ctx, screen, 190, SSFN_PIXFMT_ARGB_PRE, 0, "SSFN_PIXFMT_ARGB_PRE (premultiplied)");
+    do_format(&ctx, screen, 250, SSFN_PIXFMT_RGB565, 0, "SSFN_PIXFMT_RGB565");
+    do_format(&ctx, screen, 310, SSFN_PIXFMT_GRAY8, 0, "SSFN_PIXFMT_GRAY8");
+
+    printf("Memory allocated: %d\n", ssfn_mem(&ctx));
+    ssfn_free(&ctx);
+    free(font);
+}
+
+/**
+ * Main procedure
+ */
+int main(int argc __attribute__((unused)), char **argv)
+{
+    SDL_Window *window;
+    SDL_Surface *screen;
+    SDL_Event event;
+
+    if(SDL_Init(SDL_INIT_VIDEO|SDL_INIT_EVENTS)) {
+        fprintf(stderr,"SDL error %s\n", SDL_GetError());
+        return 2;
+    }
+
+    window = SDL_CreateWindow("SSFN pixel formats test", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 800, 600, 0);
+    screen = SDL_GetWindowSurface(window);
+    memset(screen->pixels, 0xF8, screen->pitch*screen->h);
+
+    do_test(screen, argv[1]);
+
+    do{ SDL_UpdateWindowSurface(window); SDL_Delay(10); } while(SDL_WaitEvent(&event) && event.type != SDL_QUIT &&
+        event.type != SDL_MOUSEBUTTONDOWN && event.type != SDL_KEYDOWN);
+
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return 0;
+}
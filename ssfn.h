@@ -124,6 +124,7 @@ typedef struct {
 /***** renderer API *****/
 #define SSFN_FAMILY_ANY      0xff     /* select the first loaded font */
 #define SSFN_FAMILY_BYNAME   0xfe     /* select font by its unique name */
+#define SSFN_FAMILY_BYPREFIX 0xfd     /* select the first font with its unique name starting with name */
 
 /* additional styles not stored in fonts */
 #define SSFN_STYLE_UNDERLINE   16     /* under line glyph */
@@ -137,6 +138,8 @@ typedef struct {
 #define SSFN_STYLE_ABS_SIZE  4096     /* scale absoulte height */
 #define SSFN_STYLE_NOSMOOTH  8192     /* no edge-smoothing for bitmaps */
 #define SSFN_STYLE_A        16384     /* keep original alpha channel */
+#define SSFN_STYLE_SUBPIXEL 32768     /* fractional pen positions, see ssfn_buf_t.fx */
+#define SSFN_STYLE_PIXFMT   65536     /* write pixels in the format given in ssfn_buf_t.f */
 
 /* error codes */
 #define SSFN_OK                 0     /* success */
@@ -151,6 +154,16 @@ typedef struct {
 #define SSFN_SIZE_MAX         192     /* biggest size we can render */
 #define SSFN_ITALIC_DIV         4     /* italic angle divisor, glyph top side pushed width / this pixels */
 #define SSFN_PREC               4     /* precision in bits */
+#ifndef SSFN_SUBPREC
+#define SSFN_SUBPREC            2     /* subpixel pen position precision in bits (1 to 3), quarter pixels */
+#endif
+
+/* destination pixel formats, with negative width red and blue are swapped */
+#define SSFN_PIXFMT_ARGB        0     /* 32 bit 0xAARRGGBB */
+#define SSFN_PIXFMT_BGRA        1     /* 32 bit 0xBBGGRRAA */
+#define SSFN_PIXFMT_ARGB_PRE    2     /* 32 bit 0xAARRGGBB with premultiplied alpha */
+#define SSFN_PIXFMT_RGB565      3     /* 16 bit, 5 bits red, 6 bits green, 5 bits blue */
+#define SSFN_PIXFMT_GRAY8       4     /* 8 bit luminance */
 
 /* destination frame buffer context */
 typedef struct {
@@ -162,21 +175,81 @@ typedef struct {
     int y;                            /* cursor y */
     uint32_t fg;                      /* foreground color */
     uint32_t bg;                      /* background color */
+    uint8_t f;                        /* pixel format, SSFN_PIXFMT_*, with SSFN_STYLE_PIXFMT */
+    uint8_t fx;                       /* cursor x fraction in 1 / (1 << SSFN_SUBPREC) pixels, with SSFN_STYLE_SUBPIXEL */
 } ssfn_buf_t;
 
+/* glyph mask metrics */
+typedef struct {
+    int w;                            /* mask width */
+    int h;                            /* mask height */
+    int left;                         /* cursor position from the mask's left edge */
+    int top;                          /* baseline from the mask's top edge */
+    int x;                            /* advance x (kerning included) */
+    int y;                            /* advance y (kerning included) */
+} ssfn_metrics_t;
+
+/* wrapped line, see ssfn_wrap() */
+typedef struct {
+    int offs;                         /* offset of the line's first byte in the string */
+    int len;                          /* number of bytes in the line (without trailing white space and newline) */
+    int w;                            /* width in pixels (advances and kerning) */
+    int h;                            /* height in pixels */
+    int top;                          /* ascender (baseline from the top) */
+} ssfn_line_t;
+
 /* cached bitmap struct */
+#ifdef SSFN_RASTER_COVERAGE
+/* rasterized directly at the output height, which is bigger than the size when the font's height exceeds its baseline
+ * (up to twice the size). Color indices followed by an alpha plane of the same size */
+#define SSFN__HMAX          (2 * SSFN_SIZE_MAX + 4)
+#define SSFN__PMAX          (SSFN__HMAX + SSFN__HMAX / SSFN_ITALIC_DIV)
+#define SSFN_DATA_MAX       (SSFN__PMAX * SSFN__HMAX * 2)
+#else
 #define SSFN_DATA_MAX       ((SSFN_SIZE_MAX + 4 + (SSFN_SIZE_MAX + 4) / SSFN_ITALIC_DIV) << 8)
+#endif
 typedef struct {
     uint16_t p;                       /* data buffer pitch, bytes per line */
-    uint8_t h;                        /* data buffer height */
+    uint16_t h;                       /* data buffer height */
     uint8_t o;                        /* overlap of glyph, scaled to size */
     uint8_t x;                        /* advance x, scaled to size */
     uint8_t y;                        /* advance y, scaled to size */
     uint8_t a;                        /* ascender, scaled to size */
     uint8_t d;                        /* descender, scaled to size */
+    uint8_t s;                        /* cached at the final size, 1: data is followed by an alpha plane, 2: alpha only */
     uint8_t data[SSFN_DATA_MAX];      /* data buffer */
 } ssfn_glyph_t;
 
+/* glyph cache entry */
+typedef struct ssfn_cent {
+    struct ssfn_cent *next;           /* next entry in hash chain */
+    struct ssfn_cent *clk;            /* next entry on the clock ring */
+    const ssfn_font_t *f;             /* font the glyph was rasterized from */
+    uint32_t u;                       /* UNICODE code point */
+    uint32_t k;                       /* cache height and synthetic styles */
+    uint32_t s;                       /* allocated size in bytes */
+    uint16_t c;                       /* size class */
+    uint16_t r;                       /* referenced since the clock hand last passed */
+} ssfn_cent_t;                        /* followed by an ssfn_glyph_t with only p * h bytes of data */
+#define SSFN__CLASSES          52     /* number of cache entry size classes, the biggest is 448k */
+
+#ifdef SSFN_MAXLINES
+#undef SSFN_SHAREDCACHE
+#endif
+/* the glyph cache, in static mode only with SSFN_STATICCACHE and in a caller supplied region (see ssfn_cacheregion) */
+#if !defined(SSFN_MAXLINES) || defined(SSFN_STATICCACHE)
+#define SSFN__CACHE
+#endif
+#ifdef SSFN_SHAREDCACHE
+/* glyph cache shared by renderer contexts in many threads, lock-free lookups and inserts */
+typedef struct {
+    ssfn_cent_t **c;                  /* hash table, allocated on first insert */
+    int nc;                           /* number of buckets, power of two, 0 means 4096 (set before first use) */
+    int numc, size;                   /* number of cached glyphs and their size in bytes */
+    int max;                          /* budget in bytes, no more glyphs are inserted above it, 0 means unbounded */
+} ssfn_cache_t;
+#endif
+
 /* character metrics */
 typedef struct {
     uint8_t t;                        /* type and overlap */
@@ -187,33 +260,120 @@ typedef struct {
     uint8_t y;                        /* advance y */
 } ssfn_chr_t;
 
+/* positioned glyph, see ssfn_layout() */
+typedef struct {
+    const ssfn_font_t *f;             /* font */
+    const ssfn_chr_t *c;              /* character record in font */
+    uint32_t u;                       /* UNICODE code point (or ligature) */
+    uint32_t k;                       /* glyph cache key */
+    int x;                            /* pen position, relative to the start of the run (x in subpixels with */
+    int y;                            /* SSFN_STYLE_SUBPIXEL, see SSFN_SUBPREC) */
+    int ax;                           /* advance to the next glyph (kerning included, x in the same units) */
+    int ay;
+} ssfn_gpos_t;
+
+/* loaded font with its lookup tables */
+typedef struct {
+    const ssfn_font_t *font;          /* font data */
+    uint8_t tr;                       /* 1 if verified on load, the renderer skips its bounds checks then */
+#ifndef SSFN_MAXLINES
+    uint32_t ***ci;                   /* character index, [plane][hi][lo] offsets of character records */
+    uint16_t *lt;                     /* ligature trie, first byte buckets followed by nodes */
+    int nlt;                          /* number of nodes in ligature trie */
+    uint32_t *kt;                     /* kerning index, hash of code point pairs with their offsets */
+    int nkt;                          /* number of slots in kerning index */
+#endif
+} ssfn_face_t;
+
 #ifdef SSFN_PROFILING
 #include <string.h>
 #include <sys/time.h>
 #endif
 
-/* renderer context */
+/* font registry, read-only once loaded, so it can be shared by many renderer contexts */
 typedef struct {
 #ifdef SSFN_MAXLINES
-    const ssfn_font_t *fnt[5][16];    /* static font registry */
+    ssfn_face_t fnt[5][16];           /* static font registry */
 #else
-    const ssfn_font_t **fnt[5];       /* dynamic font registry */
+    ssfn_face_t *fnt[5];              /* dynamic font registry */
+    char **bufs;                      /* allocated extra buffers */
+    int numbuf, lenbuf;
+    uint32_t *nh;                     /* name index, hash of unique names to family << 24 | (index + 1), 0 if empty */
+    int nnh, numnh;                   /* number of slots and names in name index */
+    void **maps;                      /* memory mapped font files */
+    uint32_t *lmaps;                  /* their sizes */
+    int nummap;
 #endif
-    const ssfn_font_t *s;             /* explicitly selected font */
+    int len[5];                       /* number of fonts in registry */
+    int nl;                           /* a font has a ligature without a glyph for its first character */
+} ssfn_fonts_t;
+
+/* font fallback memo entry, which face has a code point with the required family, style and size */
+#define SSFN_MEMO             256     /* number of memo entries, power of two */
+typedef struct {
+    uint32_t k;                       /* code point, style and family, 0 if unused */
+    uint8_t s;                        /* size */
+    uint8_t n;                        /* 1 if the face is the first one searched */
+    uint16_t f;                       /* family group << 12 | face index, 0xFFFF if no face has it */
+} ssfn_memo_t;
+
+/* memory allocator hooks, see ssfn_allocator() */
+typedef struct {
+    void *(*realloc)(void *data, void *ptr, uint32_t size); /* like realloc(), data is the data pointer below */
+    void (*free)(void *data, void *ptr);                    /* like free() */
+    void *data;                       /* allocator's own data, for example an arena */
+} ssfn_alloc_t;
+
+/* renderer context */
+typedef struct {
+    ssfn_fonts_t fonts;               /* own font registry */
+    const ssfn_fonts_t *fs;           /* shared font registry, or NULL to use the own */
+    const ssfn_face_t *s;             /* explicitly selected font */
     const ssfn_font_t *f;             /* font selected by best match */
+#ifdef SSFN_MAXLINES
     ssfn_glyph_t ga;                  /* glyph sketch area */
+#else
+    ssfn_glyph_t *ga;                 /* glyph sketch area, allocated on demand */
+    const ssfn_alloc_t *al;           /* allocator hooks, NULL to use SSFN_realloc and SSFN_free */
+#endif
     ssfn_glyph_t *g;                  /* current glyph pointer */
 #ifdef SSFN_MAXLINES
     uint16_t p[SSFN_MAXLINES*2];
-#else
-    ssfn_glyph_t ***c[17];            /* glyph cache */
+    uint16_t e[SSFN_MAXLINES*2];      /* edge lists */
+#endif
+#ifdef SSFN__CACHE
+    ssfn_cent_t **c, *ch;             /* glyph cache hash table, clock hand */
+    int nc, numc;                     /* hash table size, number of cached glyphs */
+    int cachemax, cachesize;          /* glyph cache budget (0 unlimited) and resident size in bytes */
+    ssfn_cent_t *cf[SSFN__CLASSES];   /* free entries in glyph cache slabs, per size class */
+    char *slab;                       /* glyph cache slabs, chained by their first pointer */
+    int slabsize;                     /* total size of slabs */
+    uint8_t *cr;                      /* caller supplied cache region instead of slabs, see ssfn_cacheregion() */
+    int crs, crt;                     /* size of the region and how much of it is carved into entries */
+    uint32_t hits, misses, evictions; /* glyph cache statistics */
+#endif
+#ifndef SSFN_MAXLINES
+#ifdef SSFN_SHAREDCACHE
+    ssfn_cache_t *sc;                 /* shared glyph cache */
+#endif
     uint16_t *p;
-    char **bufs;                      /* allocated extra buffers */
+    uint16_t *e;                      /* edge lists */
+    int ae;                           /* allocated edge list entries */
 #endif
     ssfn_chr_t *rc;                   /* pointer to current character */
-    int numbuf, lenbuf, np, ap, ox, oy, ax;
+    int np, ap, ox, oy, ax;
+    int ow, oh, ps;                   /* current glyph's output size, and if it's already scaled to that (see g->s) */
+    int mo;                           /* only measuring, glyphs not in the cache are not rasterized */
+    const char *ls;                   /* run: string position of the next glyph, NULL if not rendering a run */
+    const char *le;                   /* run: end of the bytes to render, NULL if the string's end */
+    const ssfn_face_t *lf;            /* run: face of the next glyph */
+    uint8_t *lc;                      /* run: character record of the next glyph, NULL if unknown */
+    int lr, ux0, ux1;                 /* run: length of the next glyph, underline gap of the last glyph */
+    uint32_t lu;                      /* run: code point of the next glyph */
+    const ssfn_gpos_t *lg;            /* laid out glyph to draw, skips the lookup */
+    uint32_t cu, ck;                  /* current glyph's code point and cache key */
+    ssfn_memo_t fm[SSFN_MEMO];        /* font fallback memo, cleared when fonts are loaded */
     int mx, my, lx, ly;               /* move to coordinates, last coordinates */
-    int len[5];                       /* number of fonts in registry */
     int family;                       /* required family */
     int style;                        /* required style */
     int size;                         /* required size */
@@ -229,11 +389,29 @@ uint32_t ssfn_utf8(char **str);
 
 /* normal renderer */
 int ssfn_load(ssfn_t *ctx, const void *data);                                     /* add an SSFN to context */
+int ssfn_load_into(ssfn_t *ctx, const void *data, void *buf, int size);           /* add an SSFN, inflated into buf */
+int ssfn_share(ssfn_t *ctx, const ssfn_t *src);                                   /* use fonts loaded into another context */
+#if defined(SSFN_LOADFILE) && !defined(SSFN_MAXLINES)
+int ssfn_load_file(ssfn_t *ctx, const char *path);                                /* map a font file and add it to context */
+#endif
 int ssfn_select(ssfn_t *ctx, int family, const char *name, int style, int size);  /* select font to use */
 int ssfn_render(ssfn_t *ctx, ssfn_buf_t *dst, const char *str);                   /* render a glyph to a pixel buffer */
 int ssfn_bbox(ssfn_t *ctx, const char *str, int *w, int *h, int *left, int *top); /* get bounding box */
+int ssfn_render_mask(ssfn_t *ctx, const char *str, uint8_t *mask, uint8_t *idx, int pitch, ssfn_metrics_t *m);
+                                                                                  /* render a glyph to an alpha mask */
+int ssfn_render_str(ssfn_t *ctx, ssfn_buf_t *dst, const char *str, int len, int flags); /* render a run of glyphs */
+int ssfn_layout(ssfn_t *ctx, const char *str, int len, ssfn_gpos_t *run, int max); /* lay out glyphs of a string */
+int ssfn_render_layout(ssfn_t *ctx, ssfn_buf_t *dst, const ssfn_gpos_t *run, int num); /* draw laid out glyphs */
+int ssfn_wrap(ssfn_t *ctx, const char *str, int width, ssfn_line_t *lines, int max); /* break text into lines */
 ssfn_buf_t *ssfn_text(ssfn_t *ctx, const char *str, unsigned int fg);             /* renders text to a newly allocated buffer */
 int ssfn_mem(ssfn_t *ctx);                                                        /* return how much memory is used */
+int ssfn_cachelimit(ssfn_t *ctx, int size);                                       /* set glyph cache budget */
+int ssfn_allocator(ssfn_t *ctx, const ssfn_alloc_t *al);                          /* use own allocator hooks */
+int ssfn_cacheregion(ssfn_t *ctx, void *buf, int size);                           /* keep the glyph cache in buf */
+#ifdef SSFN_SHAREDCACHE
+int ssfn_sharecache(ssfn_t *ctx, ssfn_cache_t *cache);                            /* use a shared glyph cache */
+void ssfn_cachefree(ssfn_cache_t *cache);                                         /* free a shared glyph cache */
+#endif
 void ssfn_free(ssfn_t *ctx);                                                      /* free context */
 #define ssfn_error(err) (err<0&&err>=-7?ssfn_errstr[-err]:"Unknown error")        /* return string for error code */
 extern const char *ssfn_errstr[];
@@ -350,22 +528,90 @@ static void *SSFN_memset(void *__s, int __c, size_t __n)
 #   endif
 #  endif
 
+/* allocations with the context's hooks if it has any. Shared glyph caches and ssfn_text() always use the defaults */
+#  define SSFN__realloc(c, p, s) ((c)->al ? (c)->al->realloc((c)->al->data, (p), (s)) : SSFN_realloc((p), (s)))
+#  define SSFN__free(c, p) ((c)->al ? (c)->al->free((c)->al->data, (p)) : SSFN_free(p))
+
+#  ifdef SSFN_SHAREDCACHE
+#   ifndef SSFN_atomic_load
+#    define SSFN_atomic_load(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#   endif
+#   ifndef SSFN_atomic_cas
+#    define SSFN_atomic_cas(p, o, n) __atomic_compare_exchange_n(p, o, n, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#   endif
+#   ifndef SSFN_atomic_add
+#    define SSFN_atomic_add(p, v) __atomic_fetch_add(p, v, __ATOMIC_RELAXED)
+#   endif
+#  endif
+
 # endif /* if !SSFN_MAXLINES */
 
+/* SSE2 is part of every x86_64 CPU, so there's no need to check for it in run-time. AVX2 is not, so unless it's enabled
+ * for the whole build, it's checked in run-time. That needs gcc or Clang and their runtime library, so not in static mode */
+# if !defined(SSFN_NOSIMD) && (defined(__SSE2__) || defined(_M_X64))
+#  define SSFN__SSE2
+#  include <emmintrin.h>
+#  ifdef __AVX2__
+#   define SSFN__B8 1
+#   include <immintrin.h>
+#  elif !defined(SSFN_MAXLINES) && (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#   define SSFN__B8 __builtin_cpu_supports("avx2")
+#   define SSFN__B8FN __attribute__((target("avx2")))
+#   include <immintrin.h>
+#  endif
+# endif
+/* NEON is part of every AArch64 CPU, and on 32 bit ARM the compiler only enables it if the CPU has it */
+# if !defined(SSFN_NOSIMD) && (defined(__ARM_NEON) || defined(_M_ARM64)) && !defined(__ARM_BIG_ENDIAN)
+#  define SSFN__B8 1
+#  include <arm_neon.h>
+# endif
+# if defined(SSFN__B8) && !defined(SSFN__B8FN)
+#  define SSFN__B8FN
+# endif
+
+/* memory mapping font files is only available on POSIX systems, elsewhere they are read into a buffer */
+# if defined(SSFN_LOADFILE) && !defined(SSFN_MAXLINES)
+#  ifdef _WIN32
+#   include <stdio.h>
+#  else
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#  endif
+# endif
+
 /*** Private functions ***/
 
+/* true if the i-th entry of ligature table l in font f is a ligature. The table ends with a 0 offset, or at the end
+ * magic in fonts where that's missing */
+#define SSFN__LIG(f, l, i) ((uint8_t*)((l) + (i) + 1) <= (uint8_t*)(f) + (f)->size - 4 && (l)[i] && (l)[i] < (f)->size)
+
 /* parse character table */
-static uint8_t *_ssfn_c(const ssfn_font_t *font, const char *str, int *len, uint32_t *unicode)
+static uint8_t *_ssfn_c(const ssfn_face_t *fc, const char *str, int *len, uint32_t *unicode)
 {
+    const ssfn_font_t *font;
     uint32_t i, j, u = -1U;
     uint16_t *l;
     uint8_t *ptr, *s;
 
     *len = 0; *unicode = 0;
-    if(!font || !font->characters_offs || !str || !*str) return NULL;
+    if(!fc || !(font = fc->font) || !font->characters_offs || !str || !*str) return NULL;
 
+#ifndef SSFN_MAXLINES
+    if(fc->lt) {
+        /* walk the trie in a single pass, first ligature in table order wins, just like with the linear scan */
+        l = fc->lt + 256; j = l[2]; ptr = (uint8_t*)str;
+        for(s = (uint8_t*)str, i = fc->lt[*s]; i; ) {
+            s++;
+            if(l[i * 4 + 2] && (!j || l[i * 4 + 2] < j)) { j = l[i * 4 + 2]; ptr = s; }
+            for(i = l[i * 4]; i && l[i * 4 + 3] != *s; i = l[i * 4 + 1]);
+        }
+        if(j) { u = SSFN_LIG_FIRST + j - 1; s = ptr; }
+    } else
+#endif
     if(font->ligature_offs) {
-        for(l = (uint16_t*)((uint8_t*)font + font->ligature_offs), i = 0; l[i] && u == -1U; i++) {
+        for(l = (uint16_t*)((uint8_t*)font + font->ligature_offs), i = 0; SSFN__LIG(font, l, i) && u == -1U; i++) {
             for(ptr = (uint8_t*)font + l[i], s = (uint8_t*)str; *ptr && *ptr == *s; ptr++, s++);
             if(!*ptr) { u = SSFN_LIG_FIRST + i; break; }
         }
@@ -383,6 +629,12 @@ static uint8_t *_ssfn_c(const ssfn_font_t *font, const char *str, int *len, uint
     }
     *len = (int)(s - (uint8_t*)str);
     *unicode = u;
+#ifndef SSFN_MAXLINES
+    /* if we have an index, no need to parse the table */
+    if(fc->ci)
+        return (u >> 16) <= 16 && fc->ci[u >> 16] && fc->ci[u >> 16][(u >> 8) & 0xFF] &&
+            (i = fc->ci[u >> 16][(u >> 8) & 0xFF][u & 0xFF]) ? (uint8_t*)font + i : NULL;
+#endif
     for(ptr = (uint8_t*)font + font->characters_offs, i = 0; i < 0x110000; i++) {
         if(ptr[0] == 0xFF) { i += 65535; ptr++; }
         else if((ptr[0] & 0xC0) == 0xC0) { j = (((ptr[0] & 0x3F) << 8) | ptr[1]); i += j; ptr += 2; }
@@ -398,15 +650,20 @@ static uint8_t *_ssfn_c(const ssfn_font_t *font, const char *str, int *len, uint
 /* add a line to contour */
 static void _ssfn_l(ssfn_t *ctx, int p, int h, int x, int y)
 {
+#ifdef SSFN_RASTER_COVERAGE
+    /* coverage is computed from the exact path, so only drop repeated points */
+    if(x < 0 || y < 0 || x >= p || y >= h || (ctx->lx == x && ctx->ly == y)) return;
+#else
     if(x < 0 || y < 0 || x >= p || y >= h || (
         ((ctx->lx + (1 << (SSFN_PREC-1))) >> SSFN_PREC) == ((x + (1 << (SSFN_PREC-1))) >> SSFN_PREC) &&
         ((ctx->ly + (1 << (SSFN_PREC-1))) >> SSFN_PREC) == ((y + (1 << (SSFN_PREC-1))) >> SSFN_PREC))) return;
+#endif
 #ifdef SSFN_MAXLINES
     if(ctx->np >= SSFN_MAXLINES*2-2) return;
 #else
     if(ctx->ap <= ctx->np) {
         ctx->ap = ctx->np + 512;
-        ctx->p = (uint16_t*)SSFN_realloc(ctx->p, ctx->ap * sizeof(uint16_t));
+        ctx->p = (uint16_t*)SSFN__realloc(ctx, ctx->p, ctx->ap * sizeof(uint16_t));
         if(!ctx->p) { ctx->ap = ctx->np = 0; return; }
     }
 #endif
@@ -421,41 +678,911 @@ static void _ssfn_l(ssfn_t *ctx, int p, int h, int x, int y)
     ctx->lx = x; ctx->ly = y;
 }
 
-/* add a Bezier curve to contour */
-static void _ssfn_b(ssfn_t *ctx, int p,int h, int x0,int y0, int x1,int y1, int x2,int y2, int x3,int y3, int l)
+/* add a Bezier curve to contour, subdivided until the control points are within t of the chord */
+static void _ssfn_b(ssfn_t *ctx, int p,int h, int x0,int y0, int x1,int y1, int x2,int y2, int x3,int y3, int t, int l)
 {
     int m0x, m0y, m1x, m1y, m2x, m2y, m3x, m3y, m4x, m4y,m5x, m5y;
-    if(l<4 && (x0!=x3 || y0!=y3)) {
+    /* the curve never gets farther from the chord than 3/4 of the biggest second difference */
+    m0x = x0 - 2 * x1 + x2; if(m0x < 0) m0x = -m0x;
+    m1x = x1 - 2 * x2 + x3; if(m1x < 0) m1x = -m1x;
+    m0y = y0 - 2 * y1 + y2; if(m0y < 0) m0y = -m0y;
+    m1y = y1 - 2 * y2 + y3; if(m1y < 0) m1y = -m1y;
+    if(l < 8 && 3 * ((m0x > m1x ? m0x : m1x) + (m0y > m1y ? m0y : m1y)) > 4 * t) {
         m0x = ((x1-x0)/2) + x0;     m0y = ((y1-y0)/2) + y0;
         m1x = ((x2-x1)/2) + x1;     m1y = ((y2-y1)/2) + y1;
         m2x = ((x3-x2)/2) + x2;     m2y = ((y3-y2)/2) + y2;
         m3x = ((m1x-m0x)/2) + m0x;  m3y = ((m1y-m0y)/2) + m0y;
         m4x = ((m2x-m1x)/2) + m1x;  m4y = ((m2y-m1y)/2) + m1y;
         m5x = ((m4x-m3x)/2) + m3x;  m5y = ((m4y-m3y)/2) + m3y;
-        _ssfn_b(ctx, p,h, x0,y0, m0x,m0y, m3x,m3y, m5x,m5y, l+1);
-        _ssfn_b(ctx, p,h, m5x,m5y, m4x,m4y, m2x,m2y, x3,y3, l+1);
+        _ssfn_b(ctx, p,h, x0,y0, m0x,m0y, m3x,m3y, m5x,m5y, t, l+1);
+        _ssfn_b(ctx, p,h, m5x,m5y, m4x,m4y, m2x,m2y, x3,y3, t, l+1);
+    } else _ssfn_l(ctx, p,h, x3, y3);
+}
+
+#ifdef SSFN_RASTER_COVERAGE
+/* accumulate the signed area of an edge within the scanline starting at a into c (everything in 1/16th pixels) */
+static void _ssfn_cv(int *c, int p, int a, int x0, int y0, int x1, int y1)
+{
+    int d = 1, i, t, ys, ye, xs, xe, bx, by, fa, fb;
+    if(y0 > y1) { t = x0; x0 = x1; x1 = t; t = y0; y0 = y1; y1 = t; d = -1; }
+    ys = y0 > a ? y0 : a; ye = y1 < a + (1 << SSFN_PREC) ? y1 : a + (1 << SSFN_PREC);
+    if(ys >= ye) return;
+    xs = x0 + (x1 - x0) * (ys - y0) / (y1 - y0); xe = x0 + (x1 - x0) * (ye - y0) / (y1 - y0);
+    p <<= SSFN_PREC;
+    if(xs < 0) xs = 0;
+    if(xs > p) xs = p;
+    if(xe < 0) xe = 0;
+    if(xe > p) xe = p;
+    /* split at pixel boundaries, each piece adds the area on its right to its pixel, the rest to the next one */
+    while(ys < ye) {
+        i = (xe < xs ? xs - 1 : xs) >> SSFN_PREC;
+        bx = xe > xs ? (i + 1) << SSFN_PREC : i << SSFN_PREC;
+        if((xe > xs && xe > bx) || (xe < xs && xe < bx)) by = ys + (ye - ys) * (bx - xs) / (xe - xs);
+        else { bx = xe; by = ye; }
+        fa = xs - (i << SSFN_PREC); fb = bx - (i << SSFN_PREC);
+        c[i] += d * (by - ys) * ((2 << SSFN_PREC) - fa - fb);
+        c[i + 1] += d * (by - ys) * (fa + fb);
+        xs = bx; ys = by;
+    }
+}
+#endif
+
+/* sort edges by their first scanline in k (heap sort) */
+static void _ssfn_es(uint16_t *e, uint16_t *k, int n)
+{
+    int i, j, m, r;
+    uint16_t t;
+    for(m = n, i = n / 2; m > 1;) {
+        if(i > 0) r = --i;
+        else { m--; t = e[0]; e[0] = e[m]; e[m] = t; t = k[0]; k[0] = k[m]; k[m] = t; r = 0; }
+        for(; (j = 2 * r + 1) < m; r = j) {
+            if(j + 1 < m && k[j + 1] > k[j]) j++;
+            if(k[r] >= k[j]) break;
+            t = e[r]; e[r] = e[j]; e[j] = t; t = k[r]; k[r] = k[j]; k[j] = t;
+        }
+    }
+}
+
+#ifndef SSFN_RASTER_COVERAGE
+/* scale down glyph g to w x h with a box filter, and write the nw x nh pixels from (l, t) of that into the color index
+ * plane c and alpha plane a (either can be NULL), both with pitch p. Each pixel gets the color of the sample that covers
+ * most of it */
+static void _ssfn_ds(const ssfn_glyph_t *g, uint8_t *c, uint8_t *a, int w, int h, int l, int t, int nw, int nh, int p)
+{
+    int x, y, x0, x1, y0, y1, xs, ys, xe, ye, k, pc, m, s, b, i;
+    for(y = t; y < t + nh; y++, c += c ? p : 0, a += a ? p : 0) {
+        y0 = (y << 8) * g->h / h; y1 = ((y + 1) << 8) * g->h / h;
+        for(x = l; x < l + nw; x++) {
+            x0 = (x << 8) * g->p / w; x1 = ((x + 1) << 8) * g->p / w;
+            m = s = b = 0; i = 0xFF;
+            for(ys = y0; ys < y1; ys = ye) {
+                ye = (ys & ~0xFF) + 256; if(ye > y1) ye = y1;
+                for(xs = x0; xs < x1; xs = xe) {
+                    xe = (xs & ~0xFF) + 256; if(xe > x1) xe = x1;
+                    pc = ((xe - xs) * (ye - ys)) >> 8; m += pc;
+                    k = g->data[(ys >> 8) * g->p + (xs >> 8)];
+                    if(k != 0xFF) { s += pc; if(pc > b) { b = pc; i = k; } }
+                }
+            }
+            /* pixels that round to no coverage get no color either, just like alpha only glyphs */
+            s = m ? s * 255 / m : 0;
+            if(c) c[x - l] = s ? i : 0xFF;
+            if(a) a[x - l] = s;
+        }
+    }
+}
+#endif
+
+/* read (into o) and write (c) a pixel at p in each format, as a 32 bit value with the same channel order as ARGB. The
+ * loops expand these per format, so that the format is checked once per row instead of once per pixel */
+#define SSFN__SW(c)        (((c) >> 24) | (((c) >> 8) & 0xFF00) | (((c) << 8) & 0xFF0000) | ((c) << 24))
+#define SSFN__GP32(o, p)   o = *((uint32_t*)(p))
+#define SSFN__GPBGRA(o, p) o = *((uint32_t*)(p)); o = SSFN__SW(o)
+#define SSFN__GP565(o, p)  o = *((uint16_t*)(p)); o = 0xFF000000 | ((o & 0xF800) << 8) | ((o & 0xE000) << 3) | \
+    ((o & 0x7E0) << 5) | ((o & 0x600) >> 1) | ((o & 0x1F) << 3) | ((o & 0x1C) >> 2)
+#define SSFN__GPGRAY(o, p) o = (p)[0]; o = 0xFF000000 | (o << 16) | (o << 8) | o
+#define SSFN__PP32(p, c)   *((uint32_t*)(p)) = (c)
+#define SSFN__PPBGRA(p, c) *((uint32_t*)(p)) = SSFN__SW(c)
+#define SSFN__PP565(p, c)  *((uint16_t*)(p)) = ((c >> 8) & 0xF800) | ((c >> 5) & 0x7E0) | ((c >> 3) & 0x1F)
+#define SSFN__PPGRAY(p, c) (p)[0] = (((c >> 16) & 0xFF) * 77 + ((c >> 8) & 0xFF) * 150 + (c & 0xFF) * 29) >> 8
+/* expand the statement X(GP, PP, bytes per pixel, premultiplied) for pixel format f */
+#define SSFN__PIXFMT(f, X) switch(f) { \
+        case SSFN_PIXFMT_BGRA: X(SSFN__GPBGRA, SSFN__PPBGRA, 4, 0); break; \
+        case SSFN_PIXFMT_ARGB_PRE: X(SSFN__GP32, SSFN__PP32, 4, 1); break; \
+        case SSFN_PIXFMT_RGB565: X(SSFN__GP565, SSFN__PP565, 2, 0); break; \
+        case SSFN_PIXFMT_GRAY8: X(SSFN__GPGRAY, SSFN__PPGRAY, 1, 0); break; \
+        default: X(SSFN__GP32, SSFN__PP32, 4, 0); break; \
     }
-    if(l) _ssfn_l(ctx, p,h, x3, y3);
+
+/* the pixel format to write to dst with the given style, -1 if it's not a valid one */
+static int _ssfn_pf(const ssfn_buf_t *dst, int style)
+{
+    return !(style & SSFN_STYLE_PIXFMT) ? SSFN_PIXFMT_ARGB : (dst->f > SSFN_PIXFMT_GRAY8 ? -1 : dst->f);
 }
 
+/* blend the foreground into one line of dst, from p to x <= e, see _ssfn_hl() */
+#define SSFN__HLPX(GP, PP, bp, pm) for(; x <= e; x++, p += bp) { \
+        GP(o, p); R = (o >> (16 - cs)) & 0xFF; G = (o >> 8) & 0xFF; B = (o >> cs) & 0xFF; \
+        B += ((fB - B) * fA) >> 8; G += ((fG - G) * fA) >> 8; R += ((fR - R) * fA) >> 8; \
+        o = (style & SSFN_STYLE_A ? o & 0xFF000000 : ((uint32_t)(pm ? fA + (((int)(o >> 24) * (255 - fA)) >> 8) : fA) \
+            << 24)) | (R << (16 - cs)) | (G << 8) | (B << cs); \
+        PP(p, o); \
+    }
+
+/* blend the foreground into rows y to y + t - 1 of dst from x0 to x1, skipping the ng gaps in g (exclusive ranges, in
+ * drawing order). Returns SSFN_ERR_INVINP if dst has an unknown pixel format */
+static int _ssfn_hl(const ssfn_buf_t *dst, int style, int x0, int x1, int y, int t, const int *g, int ng)
+{
+    uint8_t *p;
+    uint32_t o;
+    int i, x, e, fm = _ssfn_pf(dst, style), w = dst->w < 0 ? -dst->w : dst->w, bp, cs, fA, fR, fG, fB, R, G, B;
+
+    if(fm < 0) return SSFN_ERR_INVINP;
+    bp = fm == SSFN_PIXFMT_RGB565 ? 2 : (fm == SSFN_PIXFMT_GRAY8 ? 1 : 4);
+    cs = dst->w < 0 && fm != SSFN_PIXFMT_GRAY8 ? 16 : 0;
+    fR = (dst->fg >> 16) & 0xFF; fG = (dst->fg >> 8) & 0xFF; fB = dst->fg & 0xFF; fA = (dst->fg >> 24) & 0xFF;
+    if(x0 < 0) x0 = 0;
+    if(x1 >= w) x1 = w - 1;
+    for(; t > 0; t--, y++) {
+        if(y < 0 || y >= dst->h) continue;
+        for(i = 0, x = x0; i <= ng && x <= x1; i++) {
+            e = i < ng && g[i * 2] < x1 ? g[i * 2] : x1;
+            p = dst->ptr + y * dst->p + x * bp;
+            SSFN__PIXFMT(fm, SSFN__HLPX);
+            if(i < ng && x < g[i * 2 + 1]) x = g[i * 2 + 1];
+        }
+    }
+    return SSFN_OK;
+}
+
+/* divide by 255, exact for 0 <= x <= 65025 */
+#define SSFN__DIV255(x) (((x) + 1 + ((x) >> 8)) >> 8)
+
+#ifdef SSFN__B8
+/* blend the first n pixels of an ARGB span d with foreground f eight at once, as long as they all have the foreground
+ * color, see _ssfn_bl(). This does exactly the same math as the plain loop, so the results are identical. Returns
+ * where it stopped, the rest (less than eight pixels, or where the color map is needed) is left to the caller. The
+ * first and last pixels written are recorded in u, unless it's NULL */
+#ifdef SSFN__SSE2
+static SSFN__B8FN int _ssfn_b8(uint8_t *d, const uint8_t *a, const uint8_t *c, int n, uint32_t f, uint32_t b,
+    const uint8_t *l, int style, int *u)
+{
+    __m256i one, x255, fv, bv, dv, mlo, mhi, blo, bhi, lo, hi, t, wm;
+    __m128i av, sv, w;
+    int i, j, k;
+    one = _mm256_set1_epi16(1); x255 = _mm256_set1_epi16(255);
+    fv = _mm256_cvtepu8_epi16(_mm_set1_epi32((int)f));
+    bv = _mm256_cvtepu8_epi16(_mm_set1_epi32((int)b));
+    for(i = 0; i + 8 <= n; i += 8) {
+        av = _mm_loadl_epi64((const __m128i*)(a + i));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(av, _mm_setzero_si128())) == 0xFFFF) continue;
+        if(l) { for(j = 0; j < 8 && (!a[i + j] || c[i + j] == 0xFE); j++); if(j < 8) break; }
+        /* alpha s = fA * a / 255 (thresholded with NOAA), both for blending and writing, in 16 bit lanes */
+        av = _mm_cvtepu8_epi16(av);
+        sv = _mm_mullo_epi16(av, _mm_set1_epi16((short)(f >> 24)));
+        sv = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(sv, _mm_set1_epi16(1)), _mm_srli_epi16(sv, 8)), 8);
+        if(style & SSFN_STYLE_NOAA) sv = _mm_and_si128(_mm_cmpgt_epi16(sv, _mm_set1_epi16(127)), _mm_set1_epi16(255));
+        w = _mm_cmpgt_epi16(sv, _mm_set1_epi16(15));
+        if(!(k = _mm_movemask_epi8(w))) continue;
+        /* spread s over the channels of each pixel, four pixels in each register */
+        t = _mm256_cvtepu16_epi64(sv); mlo = _mm256_or_si256(t, _mm256_slli_epi64(t, 16));
+        mlo = _mm256_or_si256(mlo, _mm256_slli_epi64(mlo, 32));
+        t = _mm256_cvtepu16_epi64(_mm_srli_si128(sv, 8)); mhi = _mm256_or_si256(t, _mm256_slli_epi64(t, 16));
+        mhi = _mm256_or_si256(mhi, _mm256_slli_epi64(mhi, 32));
+        dv = _mm256_loadu_si256((const __m256i*)(d + i * 4));
+        if(b) { blo = bhi = bv; } else {
+            blo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(dv)); bhi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(dv, 1));
+        }
+        lo = _mm256_add_epi16(_mm256_mullo_epi16(fv, mlo), _mm256_mullo_epi16(blo, _mm256_sub_epi16(x255, mlo)));
+        hi = _mm256_add_epi16(_mm256_mullo_epi16(fv, mhi), _mm256_mullo_epi16(bhi, _mm256_sub_epi16(x255, mhi)));
+        lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(lo, one), _mm256_srli_epi16(lo, 8)), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(hi, one), _mm256_srli_epi16(hi, 8)), 8);
+        /* packing works in 128 bit halves, so pixels 2, 3 and 4, 5 must be swapped back */
+        t = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+        t = _mm256_and_si256(t, _mm256_set1_epi32(0xFFFFFF));
+        t = _mm256_or_si256(t, style & SSFN_STYLE_A ? _mm256_and_si256(dv, _mm256_set1_epi32((int)0xFF000000)) :
+            _mm256_slli_epi32(_mm256_cvtepu16_epi32(sv), 24));
+        wm = _mm256_cvtepi16_epi32(w);
+        _mm256_storeu_si256((__m256i*)(d + i * 4), _mm256_or_si256(_mm256_and_si256(wm, t), _mm256_andnot_si256(wm, dv)));
+        /* two mask bits per pixel */
+        if(u) for(j = 0; j < 8; j++) if((k >> (j << 1)) & 1) { if(u[0] > i + j) { u[0] = i + j; } u[1] = i + j; }
+    }
+    return i;
+}
+#else
+static SSFN__B8FN int _ssfn_b8(uint8_t *d, const uint8_t *a, const uint8_t *c, int n, uint32_t f, uint32_t b,
+    const uint8_t *l, int style, int *u)
+{
+    uint8x8x4_t dv;
+    uint8x8_t av, sv, wm;
+    uint16x8_t t;
+    uint8_t w[8];
+    int i, j;
+    for(i = 0; i + 8 <= n; i += 8) {
+        av = vld1_u8(a + i);
+        if(!vget_lane_u64(vreinterpret_u64_u8(av), 0)) continue;
+        if(l) { for(j = 0; j < 8 && (!a[i + j] || c[i + j] == 0xFE); j++); if(j < 8) break; }
+        /* alpha s = fA * a / 255 (thresholded with NOAA), both for blending and writing */
+        t = vmull_u8(av, vdup_n_u8((uint8_t)(f >> 24)));
+        sv = vshrn_n_u16(vaddq_u16(vaddq_u16(t, vdupq_n_u16(1)), vshrq_n_u16(t, 8)), 8);
+        if(style & SSFN_STYLE_NOAA) sv = vcgt_u8(sv, vdup_n_u8(127));
+        wm = vcgt_u8(sv, vdup_n_u8(15));
+        if(!vget_lane_u64(vreinterpret_u64_u8(wm), 0)) continue;
+        /* load the channels into separate registers, blue, green, red and alpha */
+        dv = vld4_u8(d + i * 4);
+        for(j = 0; j < 3; j++) {
+            t = vmull_u8(vdup_n_u8((uint8_t)(f >> (j << 3))), sv);
+            t = vmlal_u8(t, b ? vdup_n_u8((uint8_t)(b >> (j << 3))) : dv.val[j], vsub_u8(vdup_n_u8(255), sv));
+            t = vaddq_u16(vaddq_u16(t, vdupq_n_u16(1)), vshrq_n_u16(t, 8));
+            dv.val[j] = vbsl_u8(wm, vshrn_n_u16(t, 8), dv.val[j]);
+        }
+        if(!(style & SSFN_STYLE_A)) dv.val[3] = vbsl_u8(wm, sv, dv.val[3]);
+        vst4_u8(d + i * 4, dv);
+        if(u) { vst1_u8(w, wm); for(j = 0; j < 8; j++) if(w[j]) { if(u[0] > i + j) { u[0] = i + j; } u[1] = i + j; } }
+    }
+    return i;
+}
+#endif
+#endif
+
+/* blend the pixels of a row from i to n one by one, see _ssfn_bl(). Without anti-aliasing the color is blended with the
+ * thresholded alpha too, so edges get no mixed colors. Premultiplied colors (pm) blend the same way, but the alpha is
+ * composited too */
+#define SSFN__BLPX(GP, PP, bp, pm) for(; i < n; i++) { \
+        if(!a[i]) continue; \
+        if(c[i] == 0xFE || !l) P = f; \
+        else { \
+            P = *((uint32_t*)(l + (c[i] << 2))); \
+            if(cs) P = (P & 0xFF00FF00) | ((P >> 16) & 0xFF) | ((P & 0xFF) << 16); \
+        } \
+        A = (P >> 24) * a[i]; A = SSFN__DIV255(A); \
+        if(style & SSFN_STYLE_NOAA) A = A > 127 ? 255 : 0; \
+        if(A <= 15) continue; \
+        GP(O, d + i * bp); B = b ? b : O; \
+        for(k = 0; k < 24; k += 8) \
+            P = (P & ~(0xFFU << k)) | ((uint32_t)SSFN__DIV255(((P >> k) & 0xFF) * A + ((B >> k) & 0xFF) * (255 - A)) << k); \
+        if(pm) A += SSFN__DIV255((B >> 24) * (255 - A)); \
+        P = (style & SSFN_STYLE_A ? O & 0xFF000000 : (uint32_t)A << 24) | (P & 0xFFFFFF); \
+        PP(d + i * bp, P); \
+        if(y == ur) { if(u[0] > i) { u[0] = i; } if(u[1] < i) { u[1] = i; } } \
+    }
+
+/* blend r rows of n pixels with alpha a and color indices c (ap bytes per line) into d (dp bytes per line), which has
+ * pixel format fm. Colors are ARGB, f is the foreground, b the background (0 if the destination pixels should be used),
+ * l the color map (if any). The first and last pixels written in row ur are recorded in u */
+static void _ssfn_bl(uint8_t *d, int dp, int fm, const uint8_t *a, const uint8_t *c, int ap, int n, int r,
+    uint32_t f, uint32_t b, const uint8_t *l, int cs, int style, int ur, int *u)
+{
+    uint32_t P, O, B;
+    int i, y, k, A;
+#ifdef SSFN__B8
+    int e8 = fm == SSFN_PIXFMT_ARGB && SSFN__B8;
+#endif
+#ifdef SSFN__SSE2
+    __m128i z, one, x255, fv, bv, av, mv, sv, wm, dv, lo, hi, blo, bhi, mlo, mhi, t;
+    uint32_t tb[4], *pd;
+    uint8_t ta[4], tc[4];
+    const uint8_t *pa, *pc;
+    int j;
+#endif
+    /* convert colors to the pixel format of the destination, so that channels can be handled the same way */
+    if(cs) {
+        f = (f & 0xFF00FF00) | ((f >> 16) & 0xFF) | ((f & 0xFF) << 16);
+        b = (b & 0xFF00FF00) | ((b >> 16) & 0xFF) | ((b & 0xFF) << 16);
+    }
+#ifdef SSFN__SSE2
+    z = _mm_setzero_si128(); one = _mm_set1_epi16(1); x255 = _mm_set1_epi16(255);
+    fv = _mm_unpacklo_epi8(_mm_set1_epi32((int)f), z);
+    bv = _mm_unpacklo_epi8(_mm_set1_epi32((int)b), z);
+#endif
+    for(y = 0; y < r; y++, d += dp, a += ap, c += ap) {
+        i = 0;
+#ifdef SSFN__B8
+        /* eight pixels at once with AVX2 or NEON, if the CPU has it */
+        if(e8) i = _ssfn_b8(d, a, c, n, f, b, l, style, y == ur ? u : NULL);
+#endif
+#ifdef SSFN__SSE2
+        /* four pixels at once, as long as they all have the foreground color. This does exactly the same math as the
+         * plain loop below, so the results are identical. Glyph rows are narrow, so the last few pixels are padded in
+         * a small buffer instead of leaving them to the plain loop */
+        if(fm == SSFN_PIXFMT_ARGB)
+            for(; i < n; i += 4) {
+                if(i + 4 <= n) { pd = (uint32_t*)d + i; pa = a + i; pc = c + i; }
+                else {
+                    for(k = 0, j = i; j < n; j++) k |= a[j];
+                    if(!k) { i = n; break; }
+                    for(j = 0; j < 4; j++)
+                        if(i + j < n) { tb[j] = ((uint32_t*)d)[i + j]; ta[j] = a[i + j]; tc[j] = c[i + j]; }
+                        else { tb[j] = 0; ta[j] = 0; tc[j] = 0xFE; }
+                    pd = tb; pa = ta; pc = tc;
+                }
+                if(!(pa[0] | pa[1] | pa[2] | pa[3])) continue;
+                if(l && ((pa[0] && pc[0] != 0xFE) || (pa[1] && pc[1] != 0xFE) || (pa[2] && pc[2] != 0xFE) ||
+                    (pa[3] && pc[3] != 0xFE))) break;
+                /* alpha s = fA * a / 255 (thresholded with NOAA), both for blending and writing, in 16 bit lanes */
+                av = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)((uint32_t)pa[0] | ((uint32_t)pa[1] << 8) |
+                    ((uint32_t)pa[2] << 16) | ((uint32_t)pa[3] << 24))), z);
+                mv = _mm_mullo_epi16(av, _mm_set1_epi16((short)(f >> 24)));
+                mv = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(mv, one), _mm_srli_epi16(mv, 8)), 8);
+                sv = style & SSFN_STYLE_NOAA ? _mm_and_si128(_mm_cmpgt_epi16(mv, _mm_set1_epi16(127)), x255) : mv;
+                wm = _mm_cmpgt_epi16(sv, _mm_set1_epi16(15));
+                if(!(k = _mm_movemask_epi8(wm))) continue;
+                wm = _mm_unpacklo_epi16(wm, wm);
+                /* spread s over the channels of each pixel */
+                t = _mm_unpacklo_epi16(sv, sv);
+                mlo = _mm_unpacklo_epi32(t, t); mhi = _mm_unpackhi_epi32(t, t);
+                dv = _mm_loadu_si128((__m128i*)pd);
+                if(b) { blo = bhi = bv; } else { blo = _mm_unpacklo_epi8(dv, z); bhi = _mm_unpackhi_epi8(dv, z); }
+                lo = _mm_add_epi16(_mm_mullo_epi16(fv, mlo), _mm_mullo_epi16(blo, _mm_sub_epi16(x255, mlo)));
+                hi = _mm_add_epi16(_mm_mullo_epi16(fv, mhi), _mm_mullo_epi16(bhi, _mm_sub_epi16(x255, mhi)));
+                lo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(lo, one), _mm_srli_epi16(lo, 8)), 8);
+                hi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(hi, one), _mm_srli_epi16(hi, 8)), 8);
+                t = _mm_and_si128(_mm_packus_epi16(lo, hi), _mm_set1_epi32(0xFFFFFF));
+                t = _mm_or_si128(t, style & SSFN_STYLE_A ? _mm_and_si128(dv, _mm_set1_epi32((int)0xFF000000)) :
+                    _mm_slli_epi32(_mm_unpacklo_epi16(sv, z), 24));
+                _mm_storeu_si128((__m128i*)pd, _mm_or_si128(_mm_and_si128(wm, t), _mm_andnot_si128(wm, dv)));
+                if(pd == tb) for(j = 0; j < 4 && i + j < n; j++) ((uint32_t*)d)[i + j] = tb[j];
+                /* two mask bits per pixel */
+                if(y == ur) for(j = 0; j < 4; j++) if((k >> (j << 1)) & 1) { if(u[0] > i + j) { u[0] = i + j; } u[1] = i + j; }
+            }
+#endif
+        /* the rest one by one, in a loop specialized for the pixel format */
+        SSFN__PIXFMT(fm, SSFN__BLPX);
+    }
+}
+
+#ifdef SSFN__CACHE
 #ifndef SSFN_MAXLINES
+/* free the glyph cache slabs, all entries in them must be already evicted */
+static void _ssfn_fs(ssfn_t *ctx)
+{
+    char *s;
+    while(ctx->slab) { s = *((char**)ctx->slab); SSFN__free(ctx, ctx->slab); ctx->slab = s; }
+    SSFN_memset(ctx->cf, 0, sizeof(ctx->cf));
+    ctx->slabsize = 0;
+}
+#endif
+
+/* flush the glyph cache by freeing its slabs. With a cache region only the hash table is kept, and the rest of the
+ * region is carved into entries again from its start */
 static void _ssfn_fc(ssfn_t *ctx)
 {
-    int i, j, k;
     if(!ctx) return;
-    for(k = 0; k <= 16; k++)
-        if(ctx->c[k]) {
-            for(j = 0; j < 256; j++)
-                if(ctx->c[k][j]) {
-                    for(i = 0; i < 256; i++)
-                        if(ctx->c[k][j][i]) SSFN_free(ctx->c[k][j][i]);
-                    SSFN_free(ctx->c[k][j]);
+    if(ctx->cr) {
+        SSFN_memset(ctx->c, 0, ctx->nc * sizeof(void*));
+        ctx->crt = ctx->nc * sizeof(void*);
+    } else {
+#ifndef SSFN_MAXLINES
+        _ssfn_fs(ctx);
+        if(ctx->c) SSFN__free(ctx, ctx->c);
+#endif
+        ctx->c = NULL;
+        ctx->nc = 0;
+    }
+    ctx->ch = NULL;
+    SSFN_memset(ctx->cf, 0, sizeof(ctx->cf));
+    ctx->numc = ctx->cachesize = ctx->slabsize = 0;
+}
+
+/* size of a cache entry with size bytes of glyph data, rounded up to a size class (four per power of two) */
+static int _ssfn_cs(int size, int *c)
+{
+    int i, l;
+    size += sizeof(ssfn_cent_t) + sizeof(ssfn_glyph_t) - SSFN_DATA_MAX;
+    for(i = 0, l = 64; l < size; i++) l += 16 << (i >> 2);
+    if(c) *c = i;
+    return l;
+}
+
+/* glyph cache hash */
+static uint32_t _ssfn_ch(const ssfn_font_t *f, uint32_t u, uint32_t k)
+{
+    uint32_t h = u ^ (k << 21) ^ (k >> 11) ^ (uint32_t)((size_t)f >> 4);
+    h ^= h >> 16; h *= 0x7FEB352DU; h ^= h >> 15; h *= 0x846CA68BU; h ^= h >> 16;
+    return h;
+}
+
+/* evict the first glyph the clock hand finds not referenced since it last passed */
+static void _ssfn_cx(ssfn_t *ctx)
+{
+    ssfn_cent_t *e, **n;
+    for(e = ctx->ch->clk; e->r; e = e->clk) { e->r = 0; ctx->ch = e; }
+    if(e == ctx->ch) ctx->ch = NULL; else ctx->ch->clk = e->clk;
+    for(n = &ctx->c[_ssfn_ch(e->f, e->u, e->k) & (ctx->nc - 1)]; *n != e; n = &(*n)->next);
+    *n = e->next;
+    ctx->cachesize -= e->s;
+    ctx->numc--;
+    ctx->evictions++;
+    e->next = ctx->cf[e->c];
+    ctx->cf[e->c] = e;
+}
+
+/* evict glyphs with the clock algorithm until size more bytes fit in the cache budget */
+static void _ssfn_ce(ssfn_t *ctx, int size)
+{
+    while(ctx->ch && ctx->cachesize + size > ctx->cachemax) _ssfn_cx(ctx);
+}
+
+/* look up a glyph in the cache */
+static ssfn_cent_t *_ssfn_cg(ssfn_t *ctx, const ssfn_font_t *f, uint32_t u, uint32_t k)
+{
+    ssfn_cent_t *e;
+    if(!ctx->c) return NULL;
+    for(e = ctx->c[_ssfn_ch(f, u, k) & (ctx->nc - 1)]; e && (e->u != u || e->k != k || e->f != f); e = e->next);
+    return e;
+}
+
+/* add a new glyph to the cache with a data buffer of size bytes */
+static ssfn_cent_t *_ssfn_ca(ssfn_t *ctx, const ssfn_font_t *f, uint32_t u, uint32_t k, int size)
+{
+    ssfn_cent_t *e, *n;
+#ifndef SSFN_MAXLINES
+    ssfn_cent_t **c;
+#endif
+    char *s;
+    int i, j, l, m;
+    size = _ssfn_cs(size, &j);
+    if(j >= SSFN__CLASSES) return NULL;
+    if(ctx->cr) {
+        /* the hash table has a fixed size */
+        if(size > ctx->crs - (int)(ctx->nc * sizeof(void*))) return NULL;
+    } else {
+#ifdef SSFN_MAXLINES
+        return NULL;
+#else
+        if(ctx->numc >= ctx->nc) {
+            /* grow the hash table and rehash entries */
+            l = ctx->nc ? ctx->nc << 1 : 256;
+            c = (ssfn_cent_t**)SSFN__realloc(ctx, NULL, l * sizeof(void*));
+            if(!c) return NULL;
+            SSFN_memset(c, 0, l * sizeof(void*));
+            for(i = 0; i < ctx->nc; i++)
+                for(e = ctx->c[i]; e; e = n) {
+                    n = e->next;
+                    e->next = c[_ssfn_ch(e->f, e->u, e->k) & (l - 1)];
+                    c[_ssfn_ch(e->f, e->u, e->k) & (l - 1)] = e;
                 }
-            SSFN_free(ctx->c[k]);
-            ctx->c[k] = NULL;
+            if(ctx->c) SSFN__free(ctx, ctx->c);
+            ctx->c = c;
+            ctx->nc = l;
         }
+#endif
+    }
+    /* take the smallest free entry this glyph fits in, or carve a new one from the rest of the region (or new ones from
+     * a new slab, but the slabs must stay within the budget too). If neither is possible, evict glyphs until an entry
+     * is freed, and once the cache is empty, start carving again from the region's start (or free all slabs) */
+    if(ctx->cachemax) _ssfn_ce(ctx, size);
+    while(1) {
+        for(i = j; i < SSFN__CLASSES && !ctx->cf[i]; i++);
+        if(i < SSFN__CLASSES) break;
+        if(ctx->cr) {
+            if(ctx->crt + size <= ctx->crs) {
+                e = (ssfn_cent_t*)(ctx->cr + ctx->crt);
+                ctx->crt += size;
+                e->s = size; e->c = i = j; e->next = NULL;
+                ctx->cf[j] = e;
+                break;
+            }
+        }
+#ifndef SSFN_MAXLINES
+        else {
+            /* a slab of about 16k (or the budget if that's smaller) cut into entries of this size class */
+            l = ctx->cachemax && ctx->cachemax < 16384 ? ctx->cachemax : 16384;
+            l = (l - (int)sizeof(void*)) / size > 1 ? (l - (int)sizeof(void*)) / size : 1;
+            m = sizeof(void*) + l * size;
+            if(!ctx->slab || !ctx->cachemax || ctx->slabsize + m <= ctx->cachemax) {
+                if(!(s = (char*)SSFN__realloc(ctx, NULL, m))) return NULL;
+                *((char**)s) = ctx->slab;
+                ctx->slab = s;
+                ctx->slabsize += m;
+                for(s += sizeof(void*); l--; s += size) {
+                    e = (ssfn_cent_t*)s;
+                    e->s = size; e->c = i = j;
+                    e->next = ctx->cf[j];
+                    ctx->cf[j] = e;
+                }
+                break;
+            }
+        }
+#endif
+        if(ctx->ch) _ssfn_cx(ctx);
+        else if(ctx->cr) _ssfn_fc(ctx);
+#ifndef SSFN_MAXLINES
+        else _ssfn_fs(ctx);
+#endif
+    }
+    if(i > j + 3) {
+        /* more than twice as big, so split it, and give the rest back as free entries of the biggest classes */
+        e = ctx->cf[i];
+        ctx->cf[i] = e->next;
+        for(s = (char*)e + size, l = e->s - size; l >= 64; s += m, l -= m) {
+            for(i = 0, m = 64; i < SSFN__CLASSES - 1 && m + (16 << (i >> 2)) <= l; i++) m += 16 << (i >> 2);
+            n = (ssfn_cent_t*)s;
+            n->s = m; n->c = i;
+            n->next = ctx->cf[i];
+            ctx->cf[i] = n;
+        }
+        e->s = size; e->c = j;
+        e->next = ctx->cf[j];
+        ctx->cf[j] = e;
+    } else j = i;
+    e = ctx->cf[j];
+    ctx->cf[j] = e->next;
+    e->f = f; e->u = u; e->k = k; e->r = 0;
+    i = _ssfn_ch(f, u, k) & (ctx->nc - 1);
+    e->next = ctx->c[i];
+    ctx->c[i] = e;
+    /* insert behind the clock hand, so it will be the last one to be checked */
+    if(ctx->ch) { e->clk = ctx->ch->clk; ctx->ch->clk = e; } else e->clk = e;
+    ctx->ch = e;
+    ctx->cachesize += e->s;
+    ctx->numc++;
+    return e;
 }
+#endif
 
+#ifndef SSFN_MAXLINES
+#ifdef SSFN_SHAREDCACHE
+/* look up a glyph in the shared cache, entries are never modified once published. Nor are they evicted when their
+ * font is freed, that's why ssfn_cachefree() must be called before that */
+static ssfn_cent_t *_ssfn_sg(ssfn_cache_t *sc, const ssfn_font_t *f, uint32_t u, uint32_t k)
+{
+    ssfn_cent_t *e, **c = SSFN_atomic_load(&sc->c);
+    if(!c) return NULL;
+    for(e = SSFN_atomic_load(&c[_ssfn_ch(f, u, k) & ((sc->nc ? sc->nc : 4096) - 1)]);
+        e && (e->u != u || e->k != k || e->f != f); e = e->next);
+    return e;
+}
+
+/* publish a rasterized glyph in the shared cache, returns the entry which is in the cache */
+static ssfn_cent_t *_ssfn_sp(ssfn_cache_t *sc, ssfn_cent_t *e)
+{
+    ssfn_cent_t *n, *h, **c = SSFN_atomic_load(&sc->c), **o = NULL;
+    int l = sc->nc ? sc->nc : 4096;
+    if(!c) {
+        c = (ssfn_cent_t**)SSFN_realloc(NULL, l * sizeof(void*));
+        if(!c) { SSFN_free(e); return NULL; }
+        SSFN_memset(c, 0, l * sizeof(void*));
+        if(!SSFN_atomic_cas(&sc->c, &o, c)) { SSFN_free(c); c = o; }
+    }
+    c += _ssfn_ch(e->f, e->u, e->k) & (l - 1);
+    h = SSFN_atomic_load(c);
+    do {
+        /* another thread might have published the same glyph meanwhile */
+        for(n = h; n && (n->u != e->u || n->k != e->k || n->f != e->f); n = n->next);
+        if(n) { SSFN_free(e); return n; }
+        e->next = h;
+    } while(!SSFN_atomic_cas(c, &h, e));
+    SSFN_atomic_add(&sc->numc, 1);
+    SSFN_atomic_add(&sc->size, (int)e->s);
+    return e;
+}
+#endif
+
+/* free a font's lookup tables */
+static void _ssfn_ff(ssfn_t *ctx, ssfn_face_t *fc)
+{
+    int i, j;
+    if(!fc) return;
+    if(fc->ci) {
+        for(j = 0; j <= 16; j++)
+            if(fc->ci[j]) {
+                for(i = 0; i < 256; i++)
+                    if(fc->ci[j][i]) SSFN__free(ctx, fc->ci[j][i]);
+                SSFN__free(ctx, fc->ci[j]);
+            }
+        SSFN__free(ctx, fc->ci);
+        fc->ci = NULL;
+    }
+    if(fc->lt) { SSFN__free(ctx, fc->lt); fc->lt = NULL; }
+    if(fc->kt) { SSFN__free(ctx, fc->kt); fc->kt = NULL; }
+    fc->nlt = fc->nkt = 0;
+}
+
+#ifndef SSFN_NOINDEX
+/* build character index, so that looking up a glyph does not depend on its code point */
+static int _ssfn_ci(ssfn_t *ctx, ssfn_face_t *fc)
+{
+    uint32_t i, j, ***ci;
+    uint8_t *ptr, *end;
+
+    fc->ci = ci = (uint32_t***)SSFN__realloc(ctx, NULL, 17 * sizeof(void*));
+    if(!ci) return SSFN_ERR_ALLOC;
+    SSFN_memset(ci, 0, 17 * sizeof(void*));
+    end = (uint8_t*)fc->font + fc->font->size - 4;
+    for(ptr = (uint8_t*)fc->font + fc->font->characters_offs, i = 0; i < 0x110000 && ptr < end; i++) {
+        if(ptr[0] == 0xFF) { i += 65535; ptr++; }
+        else if((ptr[0] & 0xC0) == 0xC0) { j = (((ptr[0] & 0x3F) << 8) | ptr[1]); i += j; ptr += 2; }
+        else if((ptr[0] & 0xC0) == 0x80) { j = (ptr[0] & 0x3F); i += j; ptr++; }
+        else {
+            if(!ci[i >> 16]) {
+                ci[i >> 16] = (uint32_t**)SSFN__realloc(ctx, NULL, 256 * sizeof(void*));
+                if(!ci[i >> 16]) goto err;
+                SSFN_memset(ci[i >> 16], 0, 256 * sizeof(void*));
+            }
+            if(!ci[i >> 16][(i >> 8) & 0xFF]) {
+                ci[i >> 16][(i >> 8) & 0xFF] = (uint32_t*)SSFN__realloc(ctx, NULL, 256 * sizeof(uint32_t));
+                if(!ci[i >> 16][(i >> 8) & 0xFF]) goto err;
+                SSFN_memset(ci[i >> 16][(i >> 8) & 0xFF], 0, 256 * sizeof(uint32_t));
+            }
+            ci[i >> 16][(i >> 8) & 0xFF][i & 0xFF] = (uint32_t)(ptr - (uint8_t*)fc->font);
+            ptr += 6 + ptr[1] * (ptr[0] & 0x40 ? 6 : 5);
+        }
+    }
+    return SSFN_OK;
+err:_ssfn_ff(ctx, fc);
+    return SSFN_ERR_ALLOC;
+}
+
+/* compile ligature table into a trie. Each node has four uint16_t: first child, next sibling, ligature + 1, byte */
+static int _ssfn_lt(ssfn_t *ctx, ssfn_face_t *fc)
+{
+    uint16_t *l, *t;
+    uint8_t *s;
+    int i, j, k, a = 64;
+
+    l = (uint16_t*)((uint8_t*)fc->font + fc->font->ligature_offs);
+    fc->lt = t = (uint16_t*)SSFN__realloc(ctx, NULL, (256 + a * 4) * sizeof(uint16_t));
+    if(!t) return SSFN_ERR_ALLOC;
+    SSFN_memset(t, 0, (256 + 4) * sizeof(uint16_t));
+    fc->nlt = 1;
+    for(i = 0; i <= SSFN_LIG_LAST - SSFN_LIG_FIRST && SSFN__LIG(fc->font, l, i); i++) {
+        for(s = (uint8_t*)fc->font + l[i], j = 0; *s; s++, j = k) {
+            /* children of the root are bucketed by their first byte, the others are on a sibling list */
+            if(!j) k = t[*s];
+            else for(k = t[256 + j * 4]; k && t[256 + k * 4 + 3] != *s; k = t[256 + k * 4 + 1]);
+            if(!k) {
+                /* too big to be indexed by uint16_t, leave it to the linear scan */
+                if(fc->nlt > 65535) { SSFN__free(ctx, t); fc->lt = NULL; fc->nlt = 0; return SSFN_OK; }
+                if(fc->nlt >= a) {
+                    a <<= 1;
+                    fc->lt = (uint16_t*)SSFN__realloc(ctx, t, (256 + a * 4) * sizeof(uint16_t));
+                    if(!fc->lt) { fc->lt = t; _ssfn_ff(ctx, fc); return SSFN_ERR_ALLOC; }
+                    t = fc->lt;
+                }
+                k = fc->nlt++;
+                t[256 + k * 4] = 0; t[256 + k * 4 + 2] = 0; t[256 + k * 4 + 3] = *s;
+                if(!j) { t[256 + k * 4 + 1] = 0; t[*s] = k; }
+                else { t[256 + k * 4 + 1] = t[256 + j * 4]; t[256 + j * 4] = k; }
+            }
+        }
+        if(!t[256 + j * 4 + 2]) t[256 + j * 4 + 2] = i + 1;
+    }
+    return SSFN_OK;
+}
+#endif
+
+#if defined(SSFN_KERNINDEX) && !defined(SSFN_NOINDEX)
+/* kerning index hash */
+#define SSFN__KH(l, r) (((l) * 0x9E3779B1U) ^ ((r) * 0x85EBCA77U) ^ ((((l) * 0x9E3779B1U) ^ ((r) * 0x85EBCA77U)) >> 15))
+
+/* build kerning index, so that looking up a pair does not need scanning the kerning groups. Each slot has two
+ * uint32_t: left and right code points in the lower 24 bits (right is zero for empty slots), and the horizontal and
+ * vertical offsets in font units as signed bytes in the upper 8 bits. A pair has one slot per kerning fragment that
+ * has an offset for it. Pairs with zero offset or with a right code point of 32 or less are not stored */
+static int _ssfn_ki(ssfn_t *ctx, ssfn_face_t *fc)
+{
+    uint32_t i, j, l, r, P, c, mh, *t = NULL;
+    uint8_t *ptr, *end, *f, *frg, *g, *tmp;
+    int n, k, x, v, pass, cnt = 0;
+
+    end = (uint8_t*)fc->font + fc->font->size - 4;
+    for(pass = 0; pass < 2; pass++) {
+        for(ptr = (uint8_t*)fc->font + fc->font->characters_offs, i = 0; i < 0x110000 && ptr < end; i++) {
+            if(ptr[0] == 0xFF) { i += 65535; ptr++; continue; }
+            else if((ptr[0] & 0xC0) == 0xC0) { j = (((ptr[0] & 0x3F) << 8) | ptr[1]); i += j; ptr += 2; continue; }
+            else if((ptr[0] & 0xC0) == 0x80) { j = (ptr[0] & 0x3F); i += j; ptr++; continue; }
+            for(n = 0, f = ptr + 6; n < ptr[1]; n++) {
+                if(f[0] == 255 && f[1] == 255) { f += ptr[0] & 0x40 ? 6 : 5; continue; }
+                x = f[0];
+                if(ptr[0] & 0x40) { j = (f[5] << 24) | (f[4] << 16) | (f[3] << 8) | f[2]; f += 6; }
+                else { j = (f[4] << 16) | (f[3] << 8) | f[2]; f += 5; }
+                frg = (uint8_t*)fc->font + j;
+                if(frg >= end || (frg[0] & 0xE0) != 0xC0) continue;
+                k = (((frg[0] & 0x1F) << 8) | frg[1]) + 1;
+                for(frg += 2, g = frg, mh = 0; k-- && frg < end; frg += 8) {
+                    l = ((frg[2] & 0xF) << 16) | (frg[1] << 8) | frg[0];
+                    r = ((frg[5] & 0xF) << 16) | (frg[4] << 8) | frg[3];
+                    tmp = (uint8_t*)fc->font + fc->font->kerning_offs + ((((frg[2] >> 4) & 0xF) << 24) |
+                        (((frg[5] >> 4) & 0xF) << 16) | (frg[7] << 8) | frg[6]);
+                    for(P = l; P <= r && tmp < end; tmp += 2 + (tmp[0] & 0x80 ? 0 : tmp[0] & 0x7F))
+                        for(c = 0; c <= (uint32_t)(tmp[0] & 0x7F) && P <= r; c++, P++) {
+                            v = (signed char)tmp[1 + (tmp[0] & 0x80 ? 0 : c)];
+                            if(!v || P <= 32) continue;
+                            /* when ranges overlap, the first group that has the code point is the one that counts */
+                            if(l <= mh && frg != g) {
+                                for(j = 0; g + j < frg && !(P >= (uint32_t)(((g[j + 2] & 0xF) << 16) | (g[j + 1] << 8) |
+                                    g[j]) && P <= (uint32_t)(((g[j + 5] & 0xF) << 16) | (g[j + 4] << 8) | g[j + 3])); j += 8);
+                                if(g + j < frg) continue;
+                            }
+                            if(!pass) { cnt++; continue; }
+                            /* every fragment gets its own slot, because ssfn_render scales each offset separately */
+                            for(j = SSFN__KH(i, P) & (fc->nkt - 1); t[j * 2 + 1]; j = (j + 1) & (fc->nkt - 1));
+                            t[j * 2] = i | (x ? (uint32_t)(v & 0xFF) << 24 : 0);
+                            t[j * 2 + 1] = P | (x ? 0 : (uint32_t)(v & 0xFF) << 24);
+                        }
+                    if(r > mh) mh = r;
+                }
+            }
+            ptr += 6 + ptr[1] * (ptr[0] & 0x40 ? 6 : 5);
+        }
+        if(!pass) {
+            if(!cnt) return SSFN_OK;
+            /* at most three quarters full */
+            for(fc->nkt = 64; fc->nkt < cnt + cnt / 3; fc->nkt <<= 1);
+            fc->kt = t = (uint32_t*)SSFN__realloc(ctx, NULL, fc->nkt * 2 * sizeof(uint32_t));
+            if(!t) { fc->nkt = 0; return SSFN_ERR_ALLOC; }
+            SSFN_memset(t, 0, fc->nkt * 2 * sizeof(uint32_t));
+        }
+    }
+    return SSFN_OK;
+}
+#endif
+
+/* hash of a font's unique name */
+static uint32_t _ssfn_nh(const char *name)
+{
+    uint32_t h = 0x811C9DC5U;
+    while(*name) h = (h ^ (uint8_t)*name++) * 0x01000193U;
+    return h;
+}
+
+/* put a font into the name index. With duplicate names the lower family and index wins, the same one that walking the
+ * registry would find first */
+static void _ssfn_np(ssfn_fonts_t *fs, uint32_t v)
+{
+    const char *n = (const char*)fs->fnt[v >> 24][(v & 0xFFFFFF) - 1].font + sizeof(ssfn_font_t), *a, *b;
+    uint32_t i;
+
+    for(i = _ssfn_nh(n) & (fs->nnh - 1); fs->nh[i]; i = (i + 1) & (fs->nnh - 1)) {
+        a = n; b = (const char*)fs->fnt[fs->nh[i] >> 24][(fs->nh[i] & 0xFFFFFF) - 1].font + sizeof(ssfn_font_t);
+        while(*a && *a == *b) { a++; b++; }
+        if(*a == *b) { if(v < fs->nh[i]) { fs->nh[i] = v; } return; }
+    }
+    fs->nh[i] = v; fs->numnh++;
+}
+
+/* add the last font of a family to the name index, growing the hash to keep it at most three quarters full */
+static int _ssfn_ni(ssfn_t *ctx, int family)
+{
+    ssfn_fonts_t *fs = &ctx->fonts;
+    uint32_t *o = fs->nh;
+    int i, n = fs->nnh;
+
+    if((fs->numnh + 1) * 4 > fs->nnh * 3) {
+        fs->nnh = n ? n * 2 : 64;
+        if(!(fs->nh = (uint32_t*)SSFN__realloc(ctx, NULL, fs->nnh * sizeof(uint32_t)))) { fs->nh = o; fs->nnh = n; return SSFN_ERR_ALLOC; }
+        SSFN_memset(fs->nh, 0, fs->nnh * sizeof(uint32_t));
+        fs->numnh = 0;
+        for(i = 0; i < n; i++)
+            if(o[i]) _ssfn_np(fs, o[i]);
+        if(o) SSFN__free(ctx, o);
+    }
+    _ssfn_np(fs, ((uint32_t)family << 24) | (uint32_t)fs->len[family]);
+    return SSFN_OK;
+}
+
+#ifdef SSFN_LOADFILE
+/* check a fragment, and the kerning lists if it's a kerning fragment. Each list is walked as far as the biggest code
+ * point difference in the group could take the renderer, smaller ones stop earlier on the same path. Pixmaps can only
+ * use the first nc colors of the color map */
+static int _ssfn_vg(const ssfn_font_t *font, uint8_t *frg, uint8_t *end, int nc)
+{
+    uint8_t *tmp, *e;
+    uint32_t l, r, m, P;
+    int i, j, k;
+
+    if(frg + 2 > end) return SSFN_ERR_BADFILE;
+    if(!(frg[0] & 0x80)) {
+        /* contour */
+        j = (frg[0] & 0x3F);
+        if(frg[0] & 0x40) { j <<= 8; j |= frg[1]; frg++; }
+        j++; frg++; tmp = frg; frg += (j+3)/4;
+        if(frg > end) return SSFN_ERR_BADFILE;
+        for(i = 0; i < j; i++) {
+            k = (tmp[i >> 2] >> ((i & 3) << 1)) & 3;
+            frg += k == SSFN_CONTOUR_QUAD ? 4 : (k == SSFN_CONTOUR_CUBIC ? 6 : 2);
+            if(frg > end) return SSFN_ERR_BADFILE;
+        }
+    } else if((frg[0] & 0x60) == 0x00) {
+        /* bitmap */
+        if(frg + 2 + ((frg[0] & 0x1F) + 1) * (frg[1] + 1) > end) return SSFN_ERR_BADFILE;
+    } else if((frg[0] & 0x60) == 0x20) {
+        /* pixmap, must not overflow the renderer's decode buffer */
+        if(frg + 4 > end) return SSFN_ERR_BADFILE;
+        e = frg + 4 + (((frg[0] & 0x1F) << 8) | frg[1]) + 1;
+        for(frg += 4, i = 0; frg < e && frg < end; i += j) {
+            j = ((*frg++) & 0x7F) + 1;
+            for(k = frg[-1] & 0x80 ? 1 : j; k-- && frg < end; frg++)
+                if(*frg >= nc && *frg < 0xFE) return SSFN_ERR_BADFILE;
+        }
+        if(frg < e || frg > end || i > 65536) return SSFN_ERR_BADFILE;
+    } else if((frg[0] & 0xE0) == 0xC0) {
+        /* kerning groups */
+        k = (((frg[0] & 0x1F) << 8) | frg[1]) + 1;
+        if(!font->kerning_offs || frg + 2 + k * 8 > end) return SSFN_ERR_BADFILE;
+        for(frg += 2; k--; frg += 8) {
+            l = ((frg[2] & 0xF) << 16) | (frg[1] << 8) | frg[0];
+            r = ((frg[5] & 0xF) << 16) | (frg[4] << 8) | frg[3];
+            if(r < l) continue;
+            m = font->kerning_offs + ((((frg[2] >> 4) & 0xF) << 24) | (((frg[5] >> 4) & 0xF) << 16) | (frg[7] << 8) | frg[6]);
+            if(m >= font->size - 4) return SSFN_ERR_BADFILE;
+            for(tmp = (uint8_t*)font + m, P = r - l; ; ) {
+                if(tmp + 2 > end) return SSFN_ERR_BADFILE;
+                if((tmp[0] & 0x7F) < P) {
+                    P -= (tmp[0] & 0x7F) + 1;
+                    tmp += 2 + (tmp[0] & 0x80 ? 0 : tmp[0] & 0x7F);
+                } else {
+                    if(!(tmp[0] & 0x80) && tmp + 2 + P > end) return SSFN_ERR_BADFILE;
+                    break;
+                }
+            }
+        }
+    }
+    return SSFN_OK;
+}
+
+/* check that everything the renderer reads from a font or font collection is within size bytes */
+static int _ssfn_vf(const ssfn_font_t *font, uint32_t size)
+{
+    uint8_t *f = (uint8_t*)font, *ptr, *frg, *end;
+    uint16_t *l;
+    uint32_t i, m;
+    int n, t, nc;
+
+    if(size < sizeof(ssfn_font_t) + 4 || font->size < sizeof(ssfn_font_t) + 4 || font->size > size)
+        return SSFN_ERR_BADFILE;
+    if(!SSFN_memcmp(font->magic, SSFN_COLLECTION, 4)) {
+        for(i = 8; i < font->size; i += ((ssfn_font_t*)(f + i))->size)
+            if(_ssfn_vf((ssfn_font_t*)(f + i), font->size - i) != SSFN_OK) return SSFN_ERR_BADFILE;
+        return SSFN_OK;
+    }
+    end = f + font->size - 4;
+    if(SSFN_memcmp(font->magic, SSFN_MAGIC, 4) || SSFN_memcmp(end, SSFN_ENDMAGIC, 4) ||
+        SSFN_TYPE_FAMILY(font->type) > SSFN_FAMILY_HAND || !font->height ||
+        font->fragments_offs <= sizeof(ssfn_font_t) || font->characters_offs <= font->fragments_offs ||
+        f + font->characters_offs >= end || f + font->ligature_offs >= end || f + font->kerning_offs >= end ||
+        (font->cmap_offs && (font->cmap_offs < sizeof(ssfn_font_t) || f + font->cmap_offs > end)))
+            return SSFN_ERR_BADFILE;
+    /* the color map lasts until the end magic, without one every color is drawn with the foreground */
+    nc = font->cmap_offs ? (int)(end - f - font->cmap_offs) / 4 : 256;
+    /* unique name */
+    for(ptr = f + sizeof(ssfn_font_t); ptr < f + font->fragments_offs && *ptr; ptr++);
+    if(ptr >= f + font->fragments_offs) return SSFN_ERR_BADFILE;
+    /* ligatures, zero terminated list of zero terminated strings (see SSFN__LIG for fonts without the terminator) */
+    if(font->ligature_offs)
+        for(l = (uint16_t*)(f + font->ligature_offs); (uint8_t*)(l + 1) <= end && *l; l++) {
+            for(ptr = f + *l; ptr < end && *ptr; ptr++);
+            if(ptr >= end) return SSFN_ERR_BADFILE;
+        }
+    /* characters, the table must cover all code points and every fragment must be valid */
+    for(ptr = f + font->characters_offs, i = 0; i < 0x110000; i++) {
+        if(ptr >= end) return SSFN_ERR_BADFILE;
+        if(ptr[0] == 0xFF) { i += 65535; ptr++; }
+        else if((ptr[0] & 0xC0) == 0xC0) { i += ((ptr[0] & 0x3F) << 8) | ptr[1]; ptr += 2; }
+        else if((ptr[0] & 0xC0) == 0x80) { i += ptr[0] & 0x3F; ptr++; }
+        else {
+            t = ptr[0] & 0x40 ? 6 : 5;
+            if(ptr + 6 + ptr[1] * t > end) return SSFN_ERR_BADFILE;
+            for(n = 0, frg = ptr + 6; n < ptr[1]; n++, frg += t) {
+                if(frg[0] == 255 && frg[1] == 255) {
+                    if(frg[2] >= nc && frg[2] < 0xFE) return SSFN_ERR_BADFILE;
+                    continue;
+                }
+                m = t == 6 ? (frg[5] << 24) | (frg[4] << 16) | (frg[3] << 8) | frg[2] : (frg[4] << 16) | (frg[3] << 8) | frg[2];
+                if(m < font->fragments_offs || m >= font->size - 4 || _ssfn_vg(font, f + m, end, nc) != SSFN_OK)
+                    return SSFN_ERR_BADFILE;
+            }
+            ptr += 6 + ptr[1] * t;
+        }
+    }
+    return SSFN_OK;
+}
+#endif
+#endif /* if !SSFN_MAXLINES */
+
+/* in static mode the uncompressor is only used to inflate fonts into caller supplied buffers */
+#if !defined(SSFN_MAXLINES) || defined(SSFN_STATICCACHE)
 /*
  * gzip deflate uncompressor from stb_image.h with minor modifications to reduce dependency
  * stb_image - v2.23 - public domain image loader - http://nothings.org/stb_image.h
@@ -542,6 +1669,8 @@ typedef struct
    char *zout;
    char *zout_start;
    char *zout_end;
+   int   z_expandable;
+   const ssfn_alloc_t *al;
 
    _ssfn__zhuffman z_length, z_distance;
 } _ssfn__zbuf;
@@ -599,21 +1728,28 @@ inline static int _ssfn__zhuffman_decode(_ssfn__zbuf *a, _ssfn__zhuffman *z)
 
 static int _ssfn__zexpand(_ssfn__zbuf *z, char *zout)
 {
+#ifndef SSFN_MAXLINES
    char *q;
    int cur, limit;
+#endif
    z->zout = zout;
-   cur   = (int) (z->zout     - z->zout_start);
+#ifdef SSFN_MAXLINES
+   return 0;
+#else
+   if (!z->z_expandable) return 0;
    limit = (int) (z->zout_end - z->zout_start);
    if(limit == 8) {
        if(z->zout_start[0] != 'S' || z->zout_start[1] != 'F' || z->zout_start[2] != 'N') return 0;
        limit = *((uint32_t*)&z->zout_start[4]);
    } else return 0;
-   q = (char *) SSFN_realloc(z->zout_start, limit);
+   cur   = (int) (z->zout     - z->zout_start);
+   q = (char *) (z->al ? z->al->realloc(z->al->data, z->zout_start, limit) : SSFN_realloc(z->zout_start, limit));
    if (q == NULL) return 0;
    z->zout_start = q;
    z->zout       = q + cur;
    z->zout_end   = q + limit;
    return 1;
+#endif
 }
 
 static int _ssfn__zlength_base[31] = {
@@ -776,17 +1912,73 @@ static int _ssfn__parse_zlib(_ssfn__zbuf *a)
    return 1;
 }
 
-char *_ssfn_zlib_decode(const char *buffer)
+/* inflate into a fixed size buffer if out is given, otherwise into one allocated with al (or the defaults) */
+static char *_ssfn__zdecode(const ssfn_alloc_t *al, const char *buffer, char *out, int len)
 {
    _ssfn__zbuf a;
-   char *p = (char *) SSFN_realloc(NULL, 8);
+#ifdef SSFN_MAXLINES
+   char *p = out;
+#else
+   char *p = out ? out : (char *) (al ? al->realloc(al->data, NULL, 8) : SSFN_realloc(NULL, 8));
+#endif
    if (p == NULL) return NULL;
    a.zbuffer = (unsigned char *) buffer;
-   a.zout_start = p; a.zout = p; a.zout_end = p + 8;
+   a.zout_start = p; a.zout = p; a.zout_end = p + (out ? len : 8);
+   a.z_expandable = !out; a.al = al;
    _ssfn__init_zdefaults();
-   if (_ssfn__parse_zlib(&a)) { return a.zout_start; } else { SSFN_free(a.zout_start); return NULL; }
+   if (_ssfn__parse_zlib(&a)) return a.zout_start;
+#ifndef SSFN_MAXLINES
+   if (!out) { if (al) al->free(al->data, a.zout_start); else SSFN_free(a.zout_start); }
+#endif
+   return NULL;
+}
+
+#ifndef SSFN_MAXLINES
+char *_ssfn_zlib_decode(const char *buffer)
+{
+   return _ssfn__zdecode(NULL, buffer, NULL, 0);
+}
+#endif
+
+/* uncompress a gzipped font into buf, or into a newly allocated buffer if that's NULL */
+static ssfn_font_t *_ssfn_gz(ssfn_t *ctx, uint8_t *ptr, char *buf, int len)
+{
+    uint8_t c, r;
+
+    ptr += 2;
+    if(*ptr++ != 8) return NULL;
+    c = *ptr++; ptr += 6;
+    if(c & 4) { r = *ptr++; r += (*ptr++ << 8); ptr += r; }
+    if(c & 8) { while(*ptr++ != 0); }
+    if(c & 16) { while(*ptr++ != 0); }
+#ifdef SSFN_MAXLINES
+    (void)ctx;
+    return (ssfn_font_t*)_ssfn__zdecode(NULL, (const char*)ptr, buf, len);
+#else
+    return (ssfn_font_t*)_ssfn__zdecode(ctx->al, (const char*)ptr, buf, len);
+#endif
+}
+#endif /* if !SSFN_MAXLINES || SSFN_STATICCACHE */
+
+/* check if a face has a glyph for the first character of each of its ligatures. The font fallback memo can only
+ * remember where a code point was found if they all do, otherwise a ligature could be missed */
+static int _ssfn_lf(const ssfn_face_t *fc)
+{
+    uint16_t *l;
+    uint32_t u;
+    char c[5], *s, *e;
+    int i, j;
+
+    if(!fc->font->ligature_offs) return 1;
+    l = (uint16_t*)((uint8_t*)fc->font + fc->font->ligature_offs);
+    for(i = 0; i <= SSFN_LIG_LAST - SSFN_LIG_FIRST && SSFN__LIG(fc->font, l, i); i++) {
+        s = e = (char*)fc->font + l[i]; ssfn_utf8(&e);
+        for(j = 0; j < 4 && s + j < e; j++) c[j] = s[j];
+        c[j] = 0;
+        if(!_ssfn_c(fc, c, &j, &u)) return 0;
+    }
+    return 1;
 }
-#endif /* if !SSFN_MAXLINES */
 
 /*** Public API implementation ***/
 
@@ -801,28 +1993,27 @@ int ssfn_load(ssfn_t *ctx, const void *data)
 {
     const ssfn_font_t *font = (const ssfn_font_t *)data;
     ssfn_font_t *fnt, *end;
+    ssfn_fonts_t *fs;
+    ssfn_face_t *fc;
     int family;
 #ifndef SSFN_MAXLINES
-    uint8_t c, r, *ptr = (uint8_t *)font;
+    int i, s = -1;
 #endif
-    if(!ctx || !font)
+    if(!ctx || !font || ctx->fs)
         return SSFN_ERR_INVINP;
+    fs = &ctx->fonts;
+    /* a new font might have code points which were looked up in others or not found at all */
+    SSFN_memset(ctx->fm, 0, sizeof(ctx->fm));
     if(((uint8_t *)font)[0] == 0x1f && ((uint8_t *)font)[1] == 0x8b) {
 #ifdef SSFN_MAXLINES
         return SSFN_ERR_BADFILE;
 #else
-        ptr += 2;
-        if(*ptr++ != 8) return SSFN_ERR_BADFILE;
-        c = *ptr++; ptr += 6;
-        if(c & 4) { r = *ptr++; r += (*ptr++ << 8); ptr += r; }
-        if(c & 8) { while(*ptr++ != 0); }
-        if(c & 16) { while(*ptr++ != 0); }
-        font = (ssfn_font_t*)_ssfn_zlib_decode((const char*)ptr);
+        font = _ssfn_gz(ctx, (uint8_t*)font, NULL, 0);
         if(!font) return SSFN_ERR_BADFILE;
-        ctx->bufs = (char**)SSFN_realloc(ctx->bufs, (ctx->numbuf + 1) * sizeof(char*));
-        if(!ctx->bufs) { ctx->numbuf = 0; return SSFN_ERR_ALLOC; }
-        ctx->bufs[ctx->numbuf++] = (char*)font;
-        ctx->lenbuf += font->size;
+        fs->bufs = (char**)SSFN__realloc(ctx, fs->bufs, (fs->numbuf + 1) * sizeof(char*));
+        if(!fs->bufs) { fs->numbuf = 0; return SSFN_ERR_ALLOC; }
+        fs->bufs[fs->numbuf++] = (char*)font;
+        fs->lenbuf += font->size;
 #endif
     }
     if(!SSFN_memcmp(font->magic, SSFN_COLLECTION, 4)) {
@@ -837,22 +2028,187 @@ int ssfn_load(ssfn_t *ctx, const void *data)
             font->fragments_offs >= font->characters_offs) {
                 return SSFN_ERR_BADFILE;
         } else {
-            ctx->len[family]++;
+            fs->len[family]++;
 #ifdef SSFN_MAXLINES
-            if(ctx->len[family] > 15) return SSFN_ERR_ALLOC;
+            if(fs->len[family] > 15) return SSFN_ERR_ALLOC;
 #else
-            ctx->fnt[family] = (const ssfn_font_t**)SSFN_realloc(ctx->fnt[family], ctx->len[family]*sizeof(void*));
-            if(!ctx->fnt[family]) {
-                ctx->len[family] = 0;
+            /* the registry might be moved, so remember which one was explicitly selected */
+            for(i = 0; ctx->s && i < fs->len[family] - 1; i++)
+                if(ctx->s == &fs->fnt[family][i]) s = i;
+            fs->fnt[family] = (ssfn_face_t*)SSFN__realloc(ctx, fs->fnt[family], fs->len[family]*sizeof(ssfn_face_t));
+            if(!fs->fnt[family]) {
+                fs->len[family] = 0;
                 return SSFN_ERR_ALLOC;
-            } else
+            }
+            if(s != -1) ctx->s = &fs->fnt[family][s];
+#endif
+            fc = &fs->fnt[family][fs->len[family]-1];
+            SSFN_memset(fc, 0, sizeof(ssfn_face_t));
+            fc->font = font;
+#if !defined(SSFN_MAXLINES) && !defined(SSFN_NOINDEX)
+            if(_ssfn_ci(ctx, fc) != SSFN_OK || (font->ligature_offs && _ssfn_lt(ctx, fc) != SSFN_OK)
+#ifdef SSFN_KERNINDEX
+                || (font->kerning_offs && _ssfn_ki(ctx, fc) != SSFN_OK)
+#endif
+                ) {
+                _ssfn_ff(ctx, fc);
+                fs->len[family]--;
+                return SSFN_ERR_ALLOC;
+            }
 #endif
-                ctx->fnt[family][ctx->len[family]-1] = font;
-        }
 #ifndef SSFN_MAXLINES
-        _ssfn_fc(ctx);
+            if(_ssfn_ni(ctx, family) != SSFN_OK) {
+                _ssfn_ff(ctx, fc);
+                fs->len[family]--;
+                return SSFN_ERR_ALLOC;
+            }
+#endif
+            if(!_ssfn_lf(fc)) fs->nl = 1;
+        }
+    }
+    return SSFN_OK;
+}
+
+/**
+ * Load a font or font collection into renderer context, inflating a gzip compressed one into a caller provided buffer
+ * instead of an allocated one. The buffer must be kept until the context is freed. With SSFN_MAXLINES, compressed fonts
+ * can only be loaded this way, and only if SSFN_STATICCACHE is defined too
+ *
+ * @param ctx rendering context
+ * @param data SSFN font or font collection in memory
+ * @param buf buffer for the uncompressed font
+ * @param size size of the buffer in bytes (the gzip ISIZE trailer)
+ * @return error code
+ */
+int ssfn_load_into(ssfn_t *ctx, const void *data, void *buf, int size)
+{
+#if !defined(SSFN_MAXLINES) || defined(SSFN_STATICCACHE)
+    ssfn_font_t *font;
+#endif
+    if(!ctx || !data || ctx->fs) return SSFN_ERR_INVINP;
+    if(((uint8_t *)data)[0] != 0x1f || ((uint8_t *)data)[1] != 0x8b) return ssfn_load(ctx, data);
+#if defined(SSFN_MAXLINES) && !defined(SSFN_STATICCACHE)
+    (void)buf; (void)size;
+    return SSFN_ERR_BADFILE;
+#else
+    if(!buf) return SSFN_ERR_INVINP;
+    if(size < 8) return SSFN_ERR_ALLOC;
+    if(!(font = _ssfn_gz(ctx, (uint8_t*)data, (char*)buf, size)))
+        /* tell apart a buffer that's too small from a bad file */
+        return !SSFN_memcmp(buf, SSFN_MAGIC, 3) && ((ssfn_font_t*)buf)->size > (uint32_t)size ?
+            SSFN_ERR_ALLOC : SSFN_ERR_BADFILE;
+    return ssfn_load(ctx, font);
+#endif
+}
+
+#if defined(SSFN_LOADFILE) && !defined(SSFN_MAXLINES)
+/**
+ * Load a font or font collection from a file into renderer context. Uncompressed files are memory mapped read-only,
+ * so processes using the same font share its pages. Every table and fragment offset is checked once here, and the
+ * renderer skips its own bounds checks for these fonts
+ *
+ * @param ctx rendering context
+ * @param path file name
+ * @return error code
+ */
+int ssfn_load_file(ssfn_t *ctx, const char *path)
+{
+    ssfn_fonts_t *fs;
+    ssfn_font_t *font;
+    uint8_t *data;
+    uint32_t size, *lm;
+    void **m;
+    int i, j, ret, len[5];
+#ifdef _WIN32
+    FILE *f;
+    long n;
+#else
+    struct stat st;
+    int fd;
+#endif
+
+    if(!ctx || !path || ctx->fs) return SSFN_ERR_INVINP;
+    fs = &ctx->fonts;
+#ifdef _WIN32
+    if(!(f = fopen(path, "rb"))) return SSFN_ERR_BADFILE;
+    fseek(f, 0, SEEK_END); n = ftell(f); fseek(f, 0, SEEK_SET);
+    if(n < 8 || n > 0x7FFFFFFF) { fclose(f); return SSFN_ERR_BADFILE; }
+    if(!(data = (uint8_t*)SSFN__realloc(ctx, NULL, n))) { fclose(f); return SSFN_ERR_ALLOC; }
+    size = (uint32_t)fread(data, 1, n, f);
+    fclose(f);
+    if(size != (uint32_t)n) { SSFN__free(ctx, data); return SSFN_ERR_BADFILE; }
+#else
+    if((fd = open(path, O_RDONLY)) < 0) return SSFN_ERR_BADFILE;
+    if(fstat(fd, &st) || st.st_size < 8 || st.st_size > 0x7FFFFFFF) { close(fd); return SSFN_ERR_BADFILE; }
+    size = (uint32_t)st.st_size;
+    data = (uint8_t*)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(data == (uint8_t*)MAP_FAILED) return SSFN_ERR_ALLOC;
+#endif
+    font = (ssfn_font_t*)data;
+    if(data[0] == 0x1f && data[1] == 0x8b) {
+        /* compressed, the mapping is only needed until it's uncompressed */
+        font = _ssfn_gz(ctx, data, NULL, 0);
+#ifdef _WIN32
+        SSFN__free(ctx, data);
+#else
+        munmap(data, size);
+#endif
+        if(!font) return SSFN_ERR_BADFILE;
+        data = NULL; size = font->size;
+    }
+    if(_ssfn_vf(font, size) != SSFN_OK) {
+#ifndef _WIN32
+        if(data) munmap(data, size); else
+#endif
+        SSFN__free(ctx, font);
+        return SSFN_ERR_BADFILE;
+    }
+#ifndef _WIN32
+    if(data) {
+        m = (void**)SSFN__realloc(ctx, fs->maps, (fs->nummap + 1) * sizeof(void*));
+        if(m) fs->maps = m;
+        lm = m ? (uint32_t*)SSFN__realloc(ctx, fs->lmaps, (fs->nummap + 1) * sizeof(uint32_t)) : NULL;
+        if(!lm) { munmap(data, size); return SSFN_ERR_ALLOC; }
+        fs->lmaps = lm;
+        fs->maps[fs->nummap] = data; fs->lmaps[fs->nummap++] = size;
+    } else
 #endif
+    {
+        fs->bufs = (char**)SSFN__realloc(ctx, fs->bufs, (fs->numbuf + 1) * sizeof(char*));
+        if(!fs->bufs) { fs->numbuf = 0; SSFN__free(ctx, font); return SSFN_ERR_ALLOC; }
+        fs->bufs[fs->numbuf++] = (char*)font;
+        fs->lenbuf += font->size;
     }
+    for(i = 0; i < 5; i++) len[i] = fs->len[i];
+    ret = ssfn_load(ctx, font);
+    /* whatever got loaded has been verified */
+    for(i = 0; i < 5; i++)
+        for(j = len[i]; j < fs->len[i]; j++)
+            fs->fnt[i][j].tr = 1;
+    return ret;
+}
+#endif
+
+/**
+ * Use the fonts loaded into another context. The fonts are only read, so any number of contexts (for example one
+ * per thread) can share them as long as no more fonts are loaded into src and it is not freed before them
+ *
+ * @param ctx rendering context
+ * @param src context with the loaded fonts, or NULL to stop sharing
+ * @return error code
+ */
+int ssfn_share(ssfn_t *ctx, const ssfn_t *src)
+{
+    int i;
+
+    if(!ctx || src == ctx) return SSFN_ERR_INVINP;
+    for(i = 0; i < 5; i++)
+        if(ctx->fonts.len[i]) return SSFN_ERR_INVINP;
+    ctx->fs = src ? (src->fs ? src->fs : &src->fonts) : NULL;
+    ctx->s = NULL;
+    ctx->f = NULL;
+    SSFN_memset(ctx->fm, 0, sizeof(ctx->fm));
     return SSFN_OK;
 }
 
@@ -864,21 +2220,40 @@ int ssfn_load(ssfn_t *ctx, const void *data)
 void ssfn_free(ssfn_t *ctx)
 {
 #ifndef SSFN_MAXLINES
-    int i;
+    const ssfn_alloc_t *al;
+    int i, j;
 #endif
     if(!ctx) return;
 #ifndef SSFN_MAXLINES
     _ssfn_fc(ctx);
-    if(ctx->bufs) {
-        for(i = 0; i < ctx->numbuf; i++)
-            if(ctx->bufs[i]) SSFN_free(ctx->bufs[i]);
-        SSFN_free(ctx->bufs);
+    if(ctx->fonts.bufs) {
+        for(i = 0; i < ctx->fonts.numbuf; i++)
+            if(ctx->fonts.bufs[i]) SSFN__free(ctx, ctx->fonts.bufs[i]);
+        SSFN__free(ctx, ctx->fonts.bufs);
     }
-    for(i = 0; i < 5; i++)
-        if(ctx->fnt[i]) SSFN_free(ctx->fnt[i]);
-    if(ctx->p) SSFN_free(ctx->p);
+    if(ctx->fonts.nh) SSFN__free(ctx, ctx->fonts.nh);
+#if defined(SSFN_LOADFILE) && !defined(_WIN32)
+    for(i = 0; i < ctx->fonts.nummap; i++)
+        munmap(ctx->fonts.maps[i], ctx->fonts.lmaps[i]);
 #endif
+    if(ctx->fonts.maps) SSFN__free(ctx, ctx->fonts.maps);
+    if(ctx->fonts.lmaps) SSFN__free(ctx, ctx->fonts.lmaps);
+    for(i = 0; i < 5; i++)
+        if(ctx->fonts.fnt[i]) {
+            for(j = 0; j < ctx->fonts.len[i]; j++)
+                _ssfn_ff(ctx, &ctx->fonts.fnt[i][j]);
+            SSFN__free(ctx, ctx->fonts.fnt[i]);
+        }
+    if(ctx->p) SSFN__free(ctx, ctx->p);
+    if(ctx->e) SSFN__free(ctx, ctx->e);
+    if(ctx->ga) SSFN__free(ctx, ctx->ga);
+    /* keep the allocator, so that the context can be used again */
+    al = ctx->al;
+    SSFN_memset(ctx, 0, sizeof(ssfn_t));
+    ctx->al = al;
+#else
     SSFN_memset(ctx, 0, sizeof(ssfn_t));
+#endif
 }
 
 /**
@@ -890,69 +2265,212 @@ void ssfn_free(ssfn_t *ctx)
 int ssfn_mem(ssfn_t *ctx)
 {
 #ifdef SSFN_MAXLINES
+#ifdef SSFN_STATICCACHE
+    if(ctx && ctx->cr) return sizeof(ssfn_t) + ctx->crs;
+#endif
     return ctx ? sizeof(ssfn_t) : 0;
 #else
-    int i, j, k, ret = sizeof(ssfn_t);
+    int i, j, k, l, ret = sizeof(ssfn_t);
 
     if(!ctx) return 0;
-    for(i = 0; i < 5; i++) ret += ctx->len[i] * sizeof(ssfn_font_t*);
-    ret += ctx->lenbuf;
-    for(k = 0; k <= 16; k++) {
-        if(ctx->c[k]) {
-            for(j = 0; j < 256; j++)
-                if(ctx->c[k][j]) {
-                    for(i = 0; i < 256; i++)
-                        if(ctx->c[k][j][i]) ret += 8 + ctx->c[k][j][i]->p * ctx->c[k][j][i]->h;
-                    ret += 256 * sizeof(void*);
-                }
-            ret += 256 * sizeof(void*);
-        }
+    for(l = 0; l < 5; l++) {
+        ret += ctx->fonts.len[l] * sizeof(ssfn_face_t);
+        for(k = 0; k < ctx->fonts.len[l]; k++)
+            if(ctx->fonts.fnt[l][k].ci) {
+                for(j = 0; j <= 16; j++)
+                    if(ctx->fonts.fnt[l][k].ci[j]) {
+                        for(i = 0; i < 256; i++)
+                            if(ctx->fonts.fnt[l][k].ci[j][i]) ret += 256 * sizeof(uint32_t);
+                        ret += 256 * sizeof(void*);
+                    }
+                ret += 17 * sizeof(void*);
+            }
+        for(k = 0; k < ctx->fonts.len[l]; k++)
+            if(ctx->fonts.fnt[l][k].lt) ret += (256 + ctx->fonts.fnt[l][k].nlt * 4) * sizeof(uint16_t);
+        for(k = 0; k < ctx->fonts.len[l]; k++)
+            ret += ctx->fonts.fnt[l][k].nkt * 2 * sizeof(uint32_t);
     }
+    ret += ctx->fonts.lenbuf + ctx->fonts.nnh * sizeof(uint32_t);
+    ret += ctx->cr ? ctx->crs : ctx->slabsize + (int)(ctx->nc * sizeof(void*));
     if(ctx->p) ret += ctx->ap * sizeof(uint16_t);
+    if(ctx->e) ret += ctx->ae * sizeof(uint16_t);
+    if(ctx->ga) ret += sizeof(ssfn_glyph_t);
     return ret;
 #endif
 }
 
+/**
+ * Set the glyph cache budget. When the cached glyphs would exceed this, the least recently used ones are evicted
+ *
+ * @param ctx rendering context
+ * @param size budget in bytes, 0 for unlimited
+ * @return error code
+ */
+int ssfn_cachelimit(ssfn_t *ctx, int size)
+{
+    if(!ctx || size < 0) return SSFN_ERR_INVINP;
+#ifdef SSFN__CACHE
+    ctx->cachemax = size;
+    if(size) _ssfn_ce(ctx, 0);
+#ifndef SSFN_MAXLINES
+    /* slabs can only be freed all at once */
+    if(size && !ctx->cr && ctx->slabsize > size) _ssfn_fc(ctx);
+#endif
+#endif
+    return SSFN_OK;
+}
+
+/**
+ * Use own allocator hooks instead of SSFN_realloc and SSFN_free for everything the context allocates, its font registry,
+ * lookup tables, inflated fonts and glyph cache. It must be set before anything is allocated
+ *
+ * @param ctx rendering context
+ * @param al allocator hooks, or NULL for the defaults. Must be kept until the context is freed
+ * @return error code
+ */
+int ssfn_allocator(ssfn_t *ctx, const ssfn_alloc_t *al)
+{
+#ifndef SSFN_MAXLINES
+    int i;
+#endif
+    if(!ctx || (al && (!al->realloc || !al->free))) return SSFN_ERR_INVINP;
+#ifndef SSFN_MAXLINES
+    for(i = 0; i < 5; i++)
+        if(ctx->fonts.fnt[i]) return SSFN_ERR_INVINP;
+    if(ctx->fonts.bufs || ctx->fonts.nh || ctx->fonts.maps || (ctx->c && !ctx->cr) || ctx->slab || ctx->p || ctx->e ||
+        ctx->ga) return SSFN_ERR_INVINP;
+    ctx->al = al;
+#endif
+    return SSFN_OK;
+}
+
+/**
+ * Keep the glyph cache in a caller provided memory region instead of allocated slabs. The region is never grown, when
+ * it's full, glyphs are evicted to make room. In static mode (SSFN_MAXLINES) this needs SSFN_STATICCACHE, and without
+ * a region there's no glyph cache at all. The region must be kept until the context is freed or another one is set
+ *
+ * @param ctx rendering context
+ * @param buf memory region, or NULL to drop the current one
+ * @param size size of the region in bytes, at least 4096
+ * @return error code
+ */
+int ssfn_cacheregion(ssfn_t *ctx, void *buf, int size)
+{
+#ifdef SSFN__CACHE
+    int l;
+#endif
+    if(!ctx || (buf && size < 4096)) return SSFN_ERR_INVINP;
+#ifdef SSFN__CACHE
+    _ssfn_fc(ctx);
+    ctx->cr = NULL; ctx->crs = ctx->crt = 0;
+    ctx->c = NULL; ctx->nc = 0;
+    if(buf) {
+        /* align to pointers, and use one hash bucket for every 512 bytes. The rest is carved into entries on demand */
+        l = (int)((sizeof(void*) - ((size_t)buf & (sizeof(void*) - 1))) & (sizeof(void*) - 1));
+        ctx->cr = (uint8_t*)buf + l;
+        ctx->crs = size - l;
+        for(ctx->nc = 16; ctx->nc * 512 < ctx->crs; ctx->nc <<= 1);
+        ctx->c = (ssfn_cent_t**)ctx->cr;
+        _ssfn_fc(ctx);
+    }
+    return SSFN_OK;
+#else
+    return buf ? SSFN_ERR_INVINP : SSFN_OK;
+#endif
+}
+
+#ifdef SSFN_SHAREDCACHE
+/**
+ * Use a glyph cache shared with other contexts instead of the context's own. Any number of contexts, each used
+ * in a different thread, can look up and insert glyphs concurrently without locking. Glyphs are never evicted, the
+ * cache grows until ssfn_cachefree() unless cache->max is set. Glyphs are keyed by the font's address, so the cache
+ * must be freed before any font used with it is
+ *
+ * @param ctx rendering context
+ * @param cache zerod out or already used shared cache, or NULL to use the own cache again
+ * @return error code
+ */
+int ssfn_sharecache(ssfn_t *ctx, ssfn_cache_t *cache)
+{
+    if(!ctx || (cache && (cache->nc & (cache->nc - 1)))) return SSFN_ERR_INVINP;
+    ctx->sc = cache;
+    return SSFN_OK;
+}
+
+/**
+ * Free a shared glyph cache. No context may use it at the same time
+ *
+ * @param cache shared glyph cache
+ */
+void ssfn_cachefree(ssfn_cache_t *cache)
+{
+    ssfn_cent_t *e, *n;
+    int i;
+    if(!cache) return;
+    if(cache->c) {
+        for(i = 0; i < (cache->nc ? cache->nc : 4096); i++)
+            for(e = cache->c[i]; e; e = n) { n = e->next; SSFN_free(e); }
+        SSFN_free(cache->c);
+    }
+    cache->c = NULL;
+    cache->numc = cache->size = 0;
+}
+#endif
+
 /**
  * Set up rendering parameters
  *
  * @param ctx rendering context
  * @param family one of SSFN_FAMILY_*
- * @param name NULL or UTF-8 string if family is SSFN_FAMILY_BYNAME
+ * @param name NULL or UTF-8 string if family is SSFN_FAMILY_BYNAME or SSFN_FAMILY_BYPREFIX
  * @param style OR'd values of SSFN_STYLE_*
  * @param size how big glyph it should render, 8 - 192
  * @return error code
  */
 int ssfn_select(ssfn_t *ctx, int family, const char *name, int style, int size)
 {
+    const ssfn_fonts_t *fs;
     int i, j, l;
-
-    if(!ctx) return SSFN_ERR_INVINP;
 #ifndef SSFN_MAXLINES
-    _ssfn_fc(ctx);
+    uint32_t v;
 #endif
-    if((style & ~0x5FFF)) return SSFN_ERR_BADSTYLE;
+
+    if(!ctx) return SSFN_ERR_INVINP;
+    fs = ctx->fs ? ctx->fs : &ctx->fonts;
+    if((style & ~0x1FFFF)) return SSFN_ERR_BADSTYLE;
     if(size < 8 || size > SSFN_SIZE_MAX) return SSFN_ERR_BADSIZE;
 
-    if(family == SSFN_FAMILY_BYNAME) {
+    if(family == SSFN_FAMILY_BYNAME || family == SSFN_FAMILY_BYPREFIX) {
         if(!name || !name[0]) return SSFN_ERR_INVINP;
         for(l=0; name[l]; l++);
+#ifndef SSFN_MAXLINES
+        if(family == SSFN_FAMILY_BYNAME && fs->nh) {
+            for(i = _ssfn_nh(name) & (fs->nnh - 1); (v = fs->nh[i]); i = (i + 1) & (fs->nnh - 1))
+                if(!SSFN_memcmp(name, (uint8_t*)fs->fnt[v >> 24][(v & 0xFFFFFF) - 1].font + sizeof(ssfn_font_t), l + 1)) {
+                    ctx->s = &fs->fnt[v >> 24][(v & 0xFFFFFF) - 1];
+                    goto familyfound;
+                }
+            return SSFN_ERR_NOFACE;
+        }
+#endif
+        /* the terminating zero is compared too, unless only the beginning of the name should match */
+        if(family == SSFN_FAMILY_BYNAME) l++;
         for(i=0; i < 5; i++) {
-            for(j=0; j < ctx->len[i]; j++) {
-                if(!SSFN_memcmp(name, (uint8_t*)&ctx->fnt[i][j]->magic + sizeof(ssfn_font_t), l)) {
-                    ctx->s = ctx->fnt[i][j];
+            for(j=0; j < fs->len[i]; j++) {
+                if(!SSFN_memcmp(name, (uint8_t*)&fs->fnt[i][j].font->magic + sizeof(ssfn_font_t), l)) {
+                    ctx->s = &fs->fnt[i][j];
                     goto familyfound;
                 }
             }
         }
         return SSFN_ERR_NOFACE;
     } else {
-        if(family != SSFN_FAMILY_ANY && (family > SSFN_FAMILY_HAND || !ctx->len[family])) return SSFN_ERR_NOFACE;
+        if(family != SSFN_FAMILY_ANY && (family > SSFN_FAMILY_HAND || !fs->len[family])) return SSFN_ERR_NOFACE;
         ctx->s = NULL;
     }
 familyfound:
     ctx->f = NULL;
-    ctx->family = family;
+    ctx->family = family == SSFN_FAMILY_BYPREFIX ? SSFN_FAMILY_BYNAME : family;
     ctx->style = style;
     ctx->size = size;
     ctx->line = 0;
@@ -970,78 +2488,128 @@ familyfound:
 
 int ssfn_render(ssfn_t *ctx, ssfn_buf_t *dst, const char *str)
 {
-    ssfn_font_t **fl;
-    uint8_t *ptr = NULL, *frg, *end, *tmp, color, ci = 0, cb = 0, cs, dec[65536];
-    uint16_t r[640];
-    uint32_t unicode, P, O, *Op, *Ol;
-    unsigned long int sR, sG, sB, sA;
-    int ret = 0, i, j, k, l, p, m, n, o, s, x, y, w, h, H, a, A, b, B, nr, uix, uax;
-    int ox, oy, y0, y1, Y0, Y1, x0, x1, X0, X1, X2, xs, ys, yp, pc, fB, fG, fR, fA, bB, bG, bR, dB, dG, dR, dA;
+    const ssfn_fonts_t *fs;
+    const ssfn_face_t *fl, *fc = NULL;
+    ssfn_memo_t *me;
+    char *us;
+#ifdef SSFN__CACHE
+    ssfn_cent_t *ce;
+    uint32_t key;
+#endif
+    uint8_t *ptr = NULL, *frg, *end, *tmp, *Op, color, ci = 0, cb = 0, cs, fm, bp, dec[65536];
+    uint16_t *ee, *ea, *ex;
+    uint32_t unicode, P, O;
+    int ret = 0, i, j, k, l, p, m, n, o, s, x, y, w, h, H, a, A, b, B, nr, ne, na, uix, uax;
+    int ox, oy, x0, x1, X2, sz, ft, ps = 0, nt = 0, ph, sh, sp;
+    int uv[2];
+#ifdef SSFN_RASTER_COVERAGE
+    int cv[SSFN__PMAX + 2];
+#else
+    int X0;
+#endif
 #ifdef SSFN_PROFILING
     struct timeval tv0, tv1, tvd;
     gettimeofday(&tv0, NULL);
 #endif
-#define PUTPIXEL  O = *Ol;bR = (O >> (16 - cs)) & 0xFF; bG = (O >> 8) & 0xFF; bB = (O >> cs) & 0xFF;\
-    bB += ((fB - bB) * fA) >> 8; bG += ((fG - bG) * fA) >> 8; bR += ((fR - bR) * fA) >> 8;\
-    *Ol = (ctx->style & SSFN_STYLE_A ? O & 0xFF000000 : ((uint32_t)fA << 24)) | (bR << (16 - cs)) | (bG << 8) | (bB << cs);
 
-    if(!ctx || !str) return SSFN_ERR_INVINP;
+    if(!ctx || !str || (dst && dst->ptr && _ssfn_pf(dst, ctx->style) < 0)) return SSFN_ERR_INVINP;
+    if(ctx->lg) {
+        /* glyph from ssfn_layout(), already looked up */
+        ctx->f = ctx->lg->f; ptr = (uint8_t*)ctx->lg->c; unicode = ctx->lg->u; ret = 1;
+        goto laid;
+    }
     if(!*str) return 0;
-    if(*str == '\r') { dst->x = 0; return 1; }
-    if(*str == '\n') { dst->x = 0; dst->y += ctx->line ? ctx->line : ctx->size; return 1; }
-
+    fs = ctx->fs ? ctx->fs : &ctx->fonts;
+    /* control characters only move the pen, there's no current glyph after them */
+    if(*str == '\r') { ctx->g = NULL; dst->x = dst->fx = 0; return 1; }
+    if(*str == '\n') { ctx->g = NULL; dst->x = dst->fx = 0; dst->y += ctx->line ? ctx->line : ctx->size; return 1; }
+
+    if(ctx->ls == str && ctx->lc) {
+        /* in a run, the kerning lookahead of the previous glyph already found this one */
+        fc = ctx->lf; ctx->f = fc->font; ptr = ctx->lc; ret = ctx->lr; unicode = ctx->lu; nt = 1;
+    } else
     if(ctx->s) {
-        ctx->f = ctx->s;
-        ptr = _ssfn_c(ctx->f, str, &ret, &unicode);
+        fc = ctx->s;
+        ctx->f = fc->font;
+        ptr = _ssfn_c(fc, str, &ret, &unicode); nt = 1;
     } else {
-        /* find best match */
         p = ctx->family;
         ctx->f = NULL;
+        /* a code point missing from the required family goes through every font in every pass, so remember where it
+         * was found (or that it wasn't). A found one is only remembered if all fonts have the first character of their
+         * ligatures, otherwise an earlier font could match a ligature starting with it */
+        us = (char*)str; O = ssfn_utf8(&us); l = (int)(us - str);
+        O |= ((uint32_t)(ctx->style & 3) << 21) | ((uint32_t)(p > SSFN_FAMILY_HAND ? 5 : p) << 23) | 0x80000000;
+        me = &ctx->fm[(O ^ (O >> 8) ^ (O >> 21)) & (SSFN_MEMO - 1)];
+        if(me->k == O && me->s == ctx->size) {
+            if(me->f == 0xFFFF) { ret = l; unicode = O & 0x1FFFFF; goto memo; }
+            fc = &fs->fnt[me->f >> 12][me->f & 0xFFF];
+            if((ptr = _ssfn_c(fc, str, &ret, &unicode))) { nt = me->n; goto memo; }
+            fc = NULL;
+        }
+        /* find best match */
 again:  if(p >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = p;
         for(; n <= m; n++) {
-            fl = (ssfn_font_t **)ctx->fnt[n];
+            fl = fs->fnt[n];
             if(ctx->style & 3) {
                 /* check if we have a specific ctx->f for the requested style and size */
-                for(i=0;i<ctx->len[n];i++)
-                    if(((fl[i]->type>>4) & 3) == (ctx->style & 3) && fl[i]->height == ctx->size &&
-                        (ptr = _ssfn_c(fl[i], str, &ret, &unicode))) { ctx->f = fl[i]; break; }
+                for(i=0;i<fs->len[n];i++)
+                    if(((fl[i].font->type>>4) & 3) == (ctx->style & 3) && fl[i].font->height == ctx->size &&
+                        ++nt && (ptr = _ssfn_c(&fl[i], str, &ret, &unicode))) { fc = &fl[i]; break; }
                 /* if not, check if we have the requested size (for bitmap fonts) */
                 if(!ptr)
-                    for(i=0;i<ctx->len[n];i++)
-                        if(fl[i]->height == ctx->size && (ptr = _ssfn_c(fl[i], str, &ret, &unicode))) { ctx->f = fl[i]; break; }
+                    for(i=0;i<fs->len[n];i++)
+                        if(fl[i].font->height == ctx->size && ++nt && (ptr = _ssfn_c(&fl[i], str, &ret, &unicode))) { fc = &fl[i]; break; }
                 /* if neither size+style nor size matched, look for style match */
                 if(!ptr)
-                    for(i=0;i<ctx->len[n];i++)
-                        if(((fl[i]->type>>4) & 3) == (ctx->style & 3) && (ptr = _ssfn_c(fl[i], str, &ret, &unicode)))
-                            { ctx->f = fl[i]; break; }
+                    for(i=0;i<fs->len[n];i++)
+                        if(((fl[i].font->type>>4) & 3) == (ctx->style & 3) && ++nt && (ptr = _ssfn_c(&fl[i], str, &ret, &unicode)))
+                            { fc = &fl[i]; break; }
                 /* if bold italic was requested, check if we have at least bold or italic */
                 if(!ptr && (ctx->style & 3) == 3)
-                    for(i=0;i<ctx->len[n];i++)
-                        if(((fl[i]->type>>4) & 3) && (ptr = _ssfn_c(fl[i], str, &ret, &unicode))) { ctx->f = fl[i]; break; }
+                    for(i=0;i<fs->len[n];i++)
+                        if(((fl[i].font->type>>4) & 3) && ++nt && (ptr = _ssfn_c(&fl[i], str, &ret, &unicode))) { fc = &fl[i]; break; }
             }
             /* last resort, get the first ctx->f which has a glyph for this multibyte, no matter style */
             if(!ptr) {
-                for(i=0;i<ctx->len[n];i++)
-                    if((ptr = _ssfn_c(fl[i], str, &ret, &unicode))) { ctx->f = fl[i]; break; }
+                for(i=0;i<fs->len[n];i++)
+                    if(++nt && (ptr = _ssfn_c(&fl[i], str, &ret, &unicode))) { fc = &fl[i]; break; }
             }
         }
         /* if glyph still not found, try any family group */
         if(!ptr && p != SSFN_FAMILY_ANY) { p = SSFN_FAMILY_ANY; goto again; }
+        /* ligatures depend on the following characters, so only single code points are remembered. A ligature may
+         * start with a code point that has no glyph of its own, so a miss is only remembered without ligatures */
+        for(i = n = 0; !ptr && i < 5; i++)
+            for(j = 0; j < fs->len[i]; j++) n |= fs->fnt[i][j].font->ligature_offs != 0;
+        if(ptr ? ret == l && !fs->nl : !n) {
+            me->k = O; me->s = ctx->size; me->n = nt == 1; me->f = 0xFFFF;
+            for(i = 0; ptr && i < 5; i++)
+                if(fc >= fs->fnt[i] && fc < fs->fnt[i] + fs->len[i] && fc - fs->fnt[i] < 0xFFF)
+                    me->f = (i << 12) | (int)(fc - fs->fnt[i]);
+            if(ptr && me->f == 0xFFFF) me->k = 0;
+        }
     }
+memo:
+    /* a glyph that would go past the end of a run's bytes (like a ligature or a cut multibyte) is not rendered */
+    if(ctx->le && str + ret > ctx->le) return 0;
     if(!ptr) {
         if(ctx->style & SSFN_STYLE_NODEFGLYPH) return SSFN_ERR_NOGLYPH;
         else {
             unicode = 0;
             if(ctx->family >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = ctx->family;
             for(; n <= m && !ptr; n++)
-                if(ctx->len[n] && ctx->fnt[n][0] && !(*((uint8_t*)ctx->fnt[n][0] + ctx->fnt[n][0]->characters_offs) & 0x80))
-                    { ctx->f = ctx->fnt[n][0]; ptr = (uint8_t*)ctx->f + ctx->f->characters_offs; }
+                if(fs->len[n] && fs->fnt[n][0].font && !(*((uint8_t*)fs->fnt[n][0].font +
+                    fs->fnt[n][0].font->characters_offs) & 0x80))
+                    { fc = &fs->fnt[n][0]; ptr = (uint8_t*)fc->font + fc->font->characters_offs; }
         }
         if(!ptr) return SSFN_ERR_NOGLYPH;
     }
+    ctx->f = fc ? fc->font : NULL;
+laid:
     if(!ctx->f || !ctx->f->height || !ctx->size) return SSFN_ERR_NOFACE;
     if((unicode >> 16) > 0x10) return SSFN_ERR_INVINP;
-    ctx->rc = (ssfn_chr_t*)ptr; ptr += sizeof(ssfn_chr_t);
+    ctx->rc = (ssfn_chr_t*)ptr; ptr += sizeof(ssfn_chr_t); ctx->cu = unicode;
     H = (ctx->style & SSFN_STYLE_ABS_SIZE) || SSFN_TYPE_FAMILY(ctx->f->type) == SSFN_FAMILY_MONOSPACE || !ctx->f->baseline ?
         ctx->size : ctx->size * ctx->f->height / ctx->f->baseline;
 
@@ -1052,48 +2620,76 @@ again:  if(p >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = p;
     memcpy(&tv0, &tv1, sizeof(struct timeval));
 #endif
     /* render glyph into cache */
-#ifndef SSFN_MAXLINES
-    if(!(ctx->style & SSFN_STYLE_NOCACHE) && ctx->c[unicode >> 16] && ctx->c[unicode >> 16][(unicode >> 8) & 0xFF] &&
-        ctx->c[unicode >> 16][(unicode >> 8) & 0xFF][unicode & 0xFF]) {
-            ctx->g = ctx->c[unicode >> 16][(unicode >> 8) & 0xFF][unicode & 0xFF];
+#ifdef SSFN_RASTER_COVERAGE
+    /* no supersampling, contours are rasterized directly at the requested size */
+    h = H;
+#else
+    h = ctx->style & SSFN_STYLE_NOAA ? H : (ctx->size > ctx->f->height ? (ctx->size + 4) & ~3 : ctx->f->height);
+#endif
+    ci = (ctx->style & SSFN_STYLE_ITALIC) && !(SSFN_TYPE_STYLE(ctx->f->type) & SSFN_STYLE_ITALIC);
+    cb = (ctx->style & SSFN_STYLE_BOLD) && !(SSFN_TYPE_STYLE(ctx->f->type) & SSFN_STYLE_BOLD) ? (ctx->f->height+64)>>6 : 0;
+    /* with subpixel positioning, horizontal glyphs are rasterized shifted right by the pen's fraction */
+    ph = (ctx->style & SSFN_STYLE_SUBPIXEL) && dst && ctx->rc->x ? dst->fx & ((1 << SSFN_SUBPREC) - 1) : 0;
+#ifdef SSFN__CACHE
+    /* cached glyphs are kept across ssfn_select calls, so the key must include everything that affects rasterization.
+     * They are stored at their final size, so that's what is used instead of the sketch area's height */
+    key = H | (ci << 16) | ((cb ? 1 : 0) << 17) | (ctx->style & SSFN_STYLE_NOAA ? 1 << 18 : 0) | (ph << 19) |
+        (ctx->style & SSFN_STYLE_NOSMOOTH ? 1 << 22 : 0);
+    /* a layout is only valid with the size and style it was made with, but it can be drawn at any subpixel phase */
+    if(ctx->lg && (key & ~(7 << 19)) != (ctx->lg->k & ~(7 << 19))) return SSFN_ERR_INVINP;
+    ctx->ck = key;
+#ifdef SSFN_SHAREDCACHE
+    if(ctx->sc && !(ctx->style & SSFN_STYLE_NOCACHE) && (ce = _ssfn_sg(ctx->sc, ctx->f, unicode, key))) {
+        ctx->hits++;
+        ctx->g = (ssfn_glyph_t*)(ce + 1);
+        ps = ctx->g->s;
+    } else
+#endif
+    if(!(ctx->style & SSFN_STYLE_NOCACHE) && (ce = _ssfn_cg(ctx, ctx->f, unicode, key))) {
+        ce->r = 1;
+        ctx->hits++;
+        ctx->g = (ssfn_glyph_t*)(ce + 1);
+        ps = ctx->g->s;
     } else
 #endif
     {
-        h = ctx->style & SSFN_STYLE_NOAA ? H : (ctx->size > ctx->f->height ? (ctx->size + 4) & ~3 : ctx->f->height);
-        ci = (ctx->style & SSFN_STYLE_ITALIC) && !(SSFN_TYPE_STYLE(ctx->f->type) & SSFN_STYLE_ITALIC);
-        cb = (ctx->style & SSFN_STYLE_BOLD) && !(SSFN_TYPE_STYLE(ctx->f->type) & SSFN_STYLE_BOLD) ? (ctx->f->height+64)>>6 : 0;
         w = (ctx->rc->w * h + ctx->f->height - 1) / ctx->f->height;
-        p = w + (ci ? h / SSFN_ITALIC_DIV : 0) + cb;
+        p = w + (ci ? h / SSFN_ITALIC_DIV : 0) + cb + (ph ? (h + H - 1) / H : 0);
+        sz = p * h;
+#ifdef SSFN_RASTER_COVERAGE
+        sz <<= 1;
+        if(h > SSFN__HMAX || p > SSFN__PMAX) return SSFN_ERR_BADSIZE;
+#endif
         /* failsafe, should never happen */
-        if(p * h >= SSFN_DATA_MAX) return SSFN_ERR_BADSIZE;
+        if(sz >= SSFN_DATA_MAX) return SSFN_ERR_BADSIZE;
+#ifdef SSFN__CACHE
+        if(!(ctx->style & SSFN_STYLE_NOCACHE) && !ctx->mo) ctx->misses++;
+#endif
 #ifndef SSFN_MAXLINES
-        if(!(ctx->style & SSFN_STYLE_NOCACHE)) {
-            if(!ctx->c[unicode >> 16]) {
-                ctx->c[unicode >> 16] = (ssfn_glyph_t***)SSFN_realloc(NULL, 256 * sizeof(void*));
-                if(!ctx->c[unicode >> 16]) return SSFN_ERR_ALLOC;
-                SSFN_memset(ctx->c[unicode >> 16], 0, 256 * sizeof(void*));
-            }
-            if(!ctx->c[unicode >> 16][(unicode >> 8) & 0xFF]) {
-                ctx->c[unicode >> 16][(unicode >> 8) & 0xFF] = (ssfn_glyph_t**)SSFN_realloc(NULL, 256 * sizeof(void*));
-                if(!ctx->c[unicode >> 16][(unicode >> 8) & 0xFF]) return SSFN_ERR_ALLOC;
-                SSFN_memset(ctx->c[unicode >> 16][(unicode >> 8) & 0xFF], 0, 256 * sizeof(void*));
-            }
-            ctx->g = ctx->c[unicode >> 16][(unicode >> 8) & 0xFF][unicode & 0xFF] = (ssfn_glyph_t*)SSFN_realloc(NULL, p * h + 8);
-            if(!ctx->c[unicode >> 16][(unicode >> 8) & 0xFF][unicode & 0xFF]) return SSFN_ERR_ALLOC;
-        } else
+        if(!ctx->ga && !(ctx->ga = (ssfn_glyph_t*)SSFN__realloc(ctx, NULL, sizeof(ssfn_glyph_t)))) return SSFN_ERR_ALLOC;
+        ctx->g = ctx->ga;
+#else
+        ctx->g = &ctx->ga;
 #endif
-            ctx->g = &ctx->ga;
         x = (ctx->rc->x > 0 && ci ? (ctx->f->height - ctx->f->baseline) * h / SSFN_ITALIC_DIV / ctx->f->height : 0);
         ctx->g->p = p;
         ctx->g->h = h;
         ctx->g->x = ctx->rc->x + x;
         ctx->g->y = ctx->rc->y;
         ctx->g->o = (ctx->rc->t & 0x3F) + x;
+        /* everything but the descender is known from the character record, no need to rasterize for measuring */
+        if(ctx->mo) { ctx->g->d = 0; goto measured; }
         SSFN_memset(&ctx->g->data, 0xFF, p * h);
+#ifdef SSFN_RASTER_COVERAGE
+        SSFN_memset(&ctx->g->data[p * h], 0, p * h);
+#endif
         color = 0xFE; ctx->g->a = ctx->g->d = 0;
+        /* curves are flattened to a quarter of an output pixel */
+        ft = (h << (SSFN_PREC - 2)) / H; if(ft < 1) ft = 1;
+        sh = (ph << SSFN_PREC) * h / (H << SSFN_SUBPREC);
         for(n = 0; n < ctx->rc->n; n++) {
             if(ptr[0] == 255 && ptr[1] == 255) { color = ptr[2]; ptr += ctx->rc->t & 0x40 ? 6 : 5; continue; }
-            x = ((ptr[0] + cb) << SSFN_PREC) * h / ctx->f->height; y = (ptr[1] << SSFN_PREC) * h / ctx->f->height;
+            x = ((ptr[0] + cb) << SSFN_PREC) * h / ctx->f->height + sh; y = (ptr[1] << SSFN_PREC) * h / ctx->f->height;
             if(ctx->rc->t & 0x40) { m = (ptr[5] << 24) | (ptr[4] << 16) | (ptr[3] << 8) | ptr[2]; ptr += 6; }
             else { m = (ptr[4] << 16) | (ptr[3] << 8) | ptr[2]; ptr += 5; }
             frg = (uint8_t*)ctx->f +  m;
@@ -1105,18 +2701,29 @@ again:  if(p >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = p;
                 for(i = 0; i < j; i++) {
                     k = (frg[0] << SSFN_PREC) * h / ctx->f->height + x; m = (frg[1] << SSFN_PREC) * h / ctx->f->height + y;
                     switch((tmp[i >> 2] >> ((i & 3) << 1)) & 3) {
-                        case SSFN_CONTOUR_MOVE: ctx->mx = ctx->lx = k; ctx->my = ctx->ly = m; frg += 2; break;
+                        case SSFN_CONTOUR_MOVE:
+#ifdef SSFN_RASTER_COVERAGE
+                            /* the path is one polyline, so close the previous sub-path and put a separator point
+                             * before the next one, edges to and from that are skipped */
+                            if(ctx->np) {
+                                _ssfn_l(ctx, 65536, 65536, ctx->mx, ctx->my);
+                                _ssfn_l(ctx, 65536, 65536, 65535, 65535);
+                                _ssfn_l(ctx, 65536, 65536, k, m);
+                            }
+#endif
+                            ctx->mx = ctx->lx = k; ctx->my = ctx->ly = m; frg += 2;
+                        break;
                         case SSFN_CONTOUR_LINE: _ssfn_l(ctx, p << SSFN_PREC, h << SSFN_PREC, k, m); frg += 2; break;
                         case SSFN_CONTOUR_QUAD:
                             a = (frg[2] << SSFN_PREC) * h / ctx->f->height + x; A = (frg[3] << SSFN_PREC) * h / ctx->f->height + y;
                             _ssfn_b(ctx, p << SSFN_PREC,h << SSFN_PREC, ctx->lx,ctx->ly, ((a-ctx->lx)/2)+ctx->lx,
-                                ((A-ctx->ly)/2)+ctx->ly, ((k-a)/2)+a,((A-m)/2)+m, k,m, 0);
+                                ((A-ctx->ly)/2)+ctx->ly, ((k-a)/2)+a,((A-m)/2)+m, k,m, ft, 0);
                             frg += 4;
                         break;
                         case SSFN_CONTOUR_CUBIC:
                             a = (frg[2] << SSFN_PREC) * h / ctx->f->height + x; A = (frg[3] << SSFN_PREC) * h / ctx->f->height + y;
                             b = (frg[4] << SSFN_PREC) * h / ctx->f->height + x; B = (frg[5] << SSFN_PREC) * h / ctx->f->height + y;
-                            _ssfn_b(ctx, p << SSFN_PREC,h << SSFN_PREC, ctx->lx,ctx->ly, a,A, b,B, k,m, 0);
+                            _ssfn_b(ctx, p << SSFN_PREC,h << SSFN_PREC, ctx->lx,ctx->ly, a,A, b,B, k,m, ft, 0);
                             frg += 6;
                         break;
                     }
@@ -1124,44 +2731,134 @@ again:  if(p >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = p;
                 /* close path */
                 if(ctx->mx != ctx->lx || ctx->my != ctx->ly) { ctx->p[ctx->np+0] = ctx->mx; ctx->p[ctx->np+1] = ctx->my; ctx->np += 2; }
                 /* add rasterized vector layers to cached glyph */
+#ifndef SSFN_MAXLINES
+                if(ctx->np > 4 && ctx->ae < ctx->np) {
+                    ctx->ae = ctx->np;
+                    ctx->e = (uint16_t*)SSFN__realloc(ctx, ctx->e, ctx->ae * sizeof(uint16_t));
+                    if(!ctx->e) ctx->ae = ctx->np = 0;
+                }
+#endif
+#ifdef SSFN_RASTER_COVERAGE
                 if(ctx->np > 4) {
-                    for(b = A = B = o = 0; b < h; b++, B += p) {
+                    /* every edge which isn't horizontal, sorted by the first scanline it touches */
+                    ee = ea = ctx->e; ex = ee + ctx->np / 2;
+                    for(ne = i = 0; i < ctx->np - 3; i += 2)
+                        if(ctx->p[i+1] != ctx->p[i+3] && ctx->p[i] != 65535 && ctx->p[i+2] != 65535) {
+                            ee[ne] = i;
+                            ex[ne++] = (ctx->p[i+1] < ctx->p[i+3] ? ctx->p[i+1] : ctx->p[i+3]) >> SSFN_PREC;
+                        }
+                    _ssfn_es(ee, ex, ne);
+                    /* synthetic bold widens the coverage horizontally by the bold width on both sides. Holes are cut
+                     * by separate paths xor'd on the glyph, those must be narrowed instead, so check if the path starts
+                     * inside what's already drawn */
+                    o = (cb << SSFN_PREC) * h / ctx->f->height;
+                    if(o) {
+                        k = (ctx->p[1] >> SSFN_PREC) * p + ((ctx->p[0] + (ci ? ((h << SSFN_PREC) - ctx->p[1]) /
+                            SSFN_ITALIC_DIV : 0)) >> SSFN_PREC);
+                        if(k < p * h && ctx->g->data[k] == color && ctx->g->data[(sz >> 1) + k] > 127) o = -o;
+                    }
+                    for(b = B = na = j = 0; b < h; b++, B += p) {
                         a = b << SSFN_PREC;
-                        for(nr = 0, i = 0; i < ctx->np - 3; i += 2) {
-                            if( (ctx->p[i+1] < a && ctx->p[i+3] >= a) ||
-                                (ctx->p[i+3] < a && ctx->p[i+1] >= a)) {
-                                    if((ctx->p[i+1] >> SSFN_PREC) == (ctx->p[i+3] >> SSFN_PREC))
-                                        x = (((int)ctx->p[i]+(int)ctx->p[i+2])>>1);
-                                    else
-                                        x = ((int)ctx->p[i]) + ((a - (int)ctx->p[i+1])*
-                                            ((int)ctx->p[i+2] - (int)ctx->p[i])/
-                                            ((int)ctx->p[i+3] - (int)ctx->p[i+1]));
-                                    x >>= SSFN_PREC;
-                                    if(ci) x += (h - b) / SSFN_ITALIC_DIV;
-                                    if(cb && !o) {
-                                        if(ctx->g->data[B + x] != color) { o = -cb; A = cb; }
-                                        else { o = cb; A = -cb; }
-                                    }
-                                    for(k = 0; k < nr && x > r[k]; k++);
-                                    for(l = nr; l > k; l--) r[l] = r[l-1];
-                                    r[k] = x;
-                                    nr++;
+                        for(; j < ne && ex[j] <= b; j++) ea[na++] = ee[j];
+                        if(!na) continue;
+                        SSFN_memset(cv, 0, (p + 2) * sizeof(int));
+                        for(nr = i = 0; i < na; i++) {
+                            l = ea[i];
+                            if(ctx->p[l+1] <= a && ctx->p[l+3] <= a) continue;
+                            ea[nr++] = l;
+                            x0 = ctx->p[l]; x1 = ctx->p[l+2];
+                            if(ci) {
+                                x0 += ((h << SSFN_PREC) - ctx->p[l+1]) / SSFN_ITALIC_DIV;
+                                x1 += ((h << SSFN_PREC) - ctx->p[l+3]) / SSFN_ITALIC_DIV;
+                            }
+                            _ssfn_cv(cv, p, a, x0, ctx->p[l+1], x1, ctx->p[l+3]);
+                        }
+                        na = nr;
+                        if(!nr) continue;
+                        if(ctx->g->d < y + b) ctx->g->d = y + b;
+                        /* running sum gives the winding times the covered area, even-odd rule like the scanline fill */
+                        for(i = m = 0; i < p; i++) {
+                            m += cv[i];
+                            k = (m < 0 ? -m : m) & ((4 << (2 * SSFN_PREC)) - 1);
+                            if(k > (2 << (2 * SSFN_PREC))) k = (4 << (2 * SSFN_PREC)) - k;
+                            cv[i] = k * 255 / (2 << (2 * SSFN_PREC));
+                        }
+                        for(i = 0, s = (o < 0 ? -o : o) >> SSFN_PREC; i < p; i++) {
+                            k = cv[i];
+                            if(o) {
+                                for(l = 1; l <= s + 1; l++) {
+                                    A = i - l >= 0 ? cv[i - l] : 0; m = i + l < p ? cv[i + l] : 0;
+                                    if(o > 0 ? m < A : m > A) m = A;
+                                    if(o > 0 ? m > k : m < k) k = l <= s ? m : k + (m - k) *
+                                        ((o < 0 ? -o : o) & ((1 << SSFN_PREC) - 1)) / (1 << SSFN_PREC);
+                                }
+                            }
+                            if(!k) continue;
+                            /* same colored layers are xor'd (that's how holes are cut), other colors go on top */
+                            l = ctx->g->data[(sz >> 1) + B + i];
+                            if(ctx->g->data[B + i] == color) {
+                                k = k + l - 2 * k * l / 255;
+                                if(!k) ctx->g->data[B + i] = 0xFF;
+                            } else {
+                                if(k > 127 || k >= l) ctx->g->data[B + i] = color;
+                                k += l * (255 - k) / 255;
                             }
+                            ctx->g->data[(sz >> 1) + B + i] = k;
+                        }
+                    }
+                }
+#else
+                if(ctx->np > 4) {
+                    /* edges which cross at least one scanline, sorted by their first scanline. The active edge
+                     * list never gets longer than the number of edges already taken, so it can reuse the same array */
+                    ee = ea = ctx->e; ex = ee + ctx->np / 2;
+                    for(ne = i = 0; i < ctx->np - 3; i += 2)
+                        if((ctx->p[i+1] >> SSFN_PREC) != (ctx->p[i+3] >> SSFN_PREC)) {
+                            ee[ne] = i;
+                            ex[ne++] = ((ctx->p[i+1] < ctx->p[i+3] ? ctx->p[i+1] : ctx->p[i+3]) >> SSFN_PREC) + 1;
+                        }
+                    _ssfn_es(ee, ex, ne);
+                    /* walk the scanlines with an active edge list, kept sorted by the crossing x coordinates */
+                    for(b = A = B = o = na = j = 0; b < h; b++, B += p) {
+                        a = b << SSFN_PREC;
+                        for(; j < ne && (((ctx->p[ee[j]+1] < ctx->p[ee[j]+3] ? ctx->p[ee[j]+1] : ctx->p[ee[j]+3]) >>
+                            SSFN_PREC) + 1) <= b; j++) ea[na++] = ee[j];
+                        for(nr = i = 0; i < na; i++) {
+                            l = ea[i];
+                            if(ctx->p[l+1] < a && ctx->p[l+3] < a) continue;
+                            x = ((int)ctx->p[l]) + ((a - (int)ctx->p[l+1])*
+                                ((int)ctx->p[l+2] - (int)ctx->p[l])/
+                                ((int)ctx->p[l+3] - (int)ctx->p[l+1]));
+                            x >>= SSFN_PREC;
+                            if(ci) x += (h - b) / SSFN_ITALIC_DIV;
+                            /* edges rarely swap between scanlines, so this insertion is almost linear */
+                            for(k = nr; k > 0 && ex[k-1] > x; k--) { ea[k] = ea[k-1]; ex[k] = ex[k-1]; }
+                            ea[k] = l; ex[k] = x;
+                            nr++;
+                        }
+                        na = nr;
+                        if(cb && !o && nr) {
+                            /* bold direction is decided by the first edge of the path crossing a scanline */
+                            for(k = 0, i = 1; i < nr; i++)
+                                if(ea[i] < ea[k]) k = i;
+                            if(ctx->g->data[B + ex[k]] != color) { o = -cb; A = cb; }
+                            else { o = cb; A = -cb; }
                         }
-                        if(nr > 1 && nr & 1) { r[nr - 2] = r[nr - 1]; nr--; }
+                        if(nr > 1 && nr & 1) { ex[nr - 2] = ex[nr - 1]; nr--; }
                         if(nr) {
                             if(ctx->g->d < y + b) ctx->g->d = y + b;
                             for(i = 0; i < nr - 1; i += 2) {
-                                l = r[i] + o; m = r[i + 1] + A;
+                                l = ex[i] + o; m = ex[i + 1] + A;
                                 if(l < 0) l = 0;
                                 if(m > p) m = p;
-                                if(i > 0 && l < r[i - 1] + A) l = r[i - 1] + A;
+                                if(i > 0 && l < ex[i - 1] + A) l = ex[i - 1] + A;
                                 for(; l < m; l++)
                                     ctx->g->data[B + l] = ctx->g->data[B + l] == color ? 0xFF : color;
                             }
                         }
                     }
                 }
+#endif
             } else if((frg[0] & 0x60) == 0x00) {
                 /* bitmap */
                 B = ((frg[0] & 0x1F) + 1) << 3; A = frg[1] + 1; x >>= SSFN_PREC; y >>= SSFN_PREC;
@@ -1174,7 +2871,7 @@ again:  if(p >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = p;
                     for(i = 0; i < b; i++) {
                         m = i * B / b;
                         if(frg[(k * B + m) >> 3] & (1 << (m & 7))) {
-                            for(o = 0; o <= cb; o++)
+                            for(o = 0; o <= cb && l + i + o < p * h; o++)
                                 ctx->g->data[l + i + o] = color;
                         }
                     }
@@ -1182,13 +2879,13 @@ again:  if(p >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = p;
                 if(!(ctx->style & (SSFN_STYLE_NOAA|SSFN_STYLE_NOSMOOTH))) {
                     m = color == 0xFD ? 0xFC : 0xFD; o = y * p + p + x;
                     for(k = h; k > ctx->f->height + 4; k -= 2*ctx->f->height) {
-                        for(j = 1, l = o; j < a - 1; j++, l += p)
+                        for(j = 1, l = o; j < a - 1 && l + p + b <= p * h; j++, l += p)
                             for(i = 1; i < b - 1; i++) {
                                 if(ctx->g->data[l + i] == 0xFF && (ctx->g->data[l + i - p] == color ||
                                     ctx->g->data[l + i + p] == color) && (ctx->g->data[l + i - 1] == color ||
                                     ctx->g->data[l + i + 1] == color)) ctx->g->data[l + i] = m;
                             }
-                        for(j = 1, l = o; j < a - 1; j++, l += p)
+                        for(j = 1, l = o; j < a - 1 && l + b <= p * h; j++, l += p)
                             for(i = 1; i < b - 1; i++) {
                                 if(ctx->g->data[l + i] == m) ctx->g->data[l + i] = color;
                             }
@@ -1212,18 +2909,86 @@ again:  if(p >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = p;
                     l = (y + j) * p + x + (ci ? (h - y - j) / SSFN_ITALIC_DIV : 0);
                     for(i = 0; i < b; i++) {
                         m = dec[k + i * B / b];
-                        if(m != 0xFF) ctx->g->data[l + i] = m;
+                        if(m != 0xFF && l + i < p * h) ctx->g->data[l + i] = m;
                     }
                 }
             }
             color = 0xFE;
         }
+#ifdef SSFN_RASTER_COVERAGE
+        /* bitmap and pixmap layers are opaque */
+        for(i = 0; i < p * h; i++)
+            if(ctx->g->data[i] != 0xFF && !ctx->g->data[p * h + i]) ctx->g->data[p * h + i] = 255;
+#endif
+measured:
         ctx->g->a = ctx->f->baseline;
         if(ctx->g->d > ctx->g->a + 1) ctx->g->d -= ctx->g->a + 1; else ctx->g->d = 0;
+#ifdef SSFN_RASTER_COVERAGE
+        ps = 1;
+#endif
 #ifdef SSFN_DEBUGGLYPH
         printf("\nU+%06X size %d p %d h %d base %d under %d overlap %d ascender %d descender %d advance x %d advance y %d cb %d\n",
             unicode, ctx->size,p,h,ctx->f->baseline,ctx->f->underline,ctx->g->o,ctx->g->a,ctx->g->d,ctx->g->x,ctx->g->y,cb);
-        for(j = 0; j < h; j++) { printf("%3d: ", j); for(i = 0; i < p; i++) { if(ctx->g->data[j*p+i] == 0xFF) printf(j == ctx->g->a ? "_" : "."); else printf("%x", ctx->g->data[j*p+i] & 0xF); } printf("\n"); }
+        if(!ctx->mo) for(j = 0; j < h; j++) { printf("%3d: ", j); for(i = 0; i < p; i++) { if(ctx->g->data[j*p+i] == 0xFF) printf(j == ctx->g->a ? "_" : "."); else printf("%x", ctx->g->data[j*p+i] & 0xF); } printf("\n"); }
+#endif
+#ifdef SSFN__CACHE
+        /* store the glyph at its final size, so that drawing it again needs no resampling. Those too big for that are
+         * stored as rasterized, and glyphs that would not fit in the budget (or in the cache region) at all are blitted
+         * from the sketch area. Glyphs thinner than a pixel at the final size (like 'l' or '|' at small sizes) are
+         * stored one pixel wide, so they don't have to be scaled on every blit either */
+#ifdef SSFN_MAXLINES
+        if(ctx->cr && !(ctx->style & SSFN_STYLE_NOCACHE) && !ctx->mo) {
+#else
+        if(!(ctx->style & SSFN_STYLE_NOCACHE) && !ctx->mo) {
+#endif
+            w = ctx->g->p * H / ctx->g->h; if(!w && ctx->g->p) { w = 1; }
+#ifdef SSFN_RASTER_COVERAGE
+            s = 1;
+#else
+            s = H < 256;
+#endif
+            /* most glyphs have no colors of their own, for those the color index plane would be all 0xFE and 0xFF,
+             * so only the alpha plane is stored */
+            if(s) {
+                for(i = 0, k = ctx->g->p * ctx->g->h; i < k && ctx->g->data[i] >= 0xFE; i++);
+                if(i == k) s = 2;
+            }
+            sz = !s ? ctx->g->p * ctx->g->h : (s == 2 ? w * H : w * H * 2); ce = NULL;
+            /* glyphs bigger than the biggest size class are not cached */
+            k = _ssfn_cs(sz, &j);
+#ifdef SSFN_SHAREDCACHE
+            if(ctx->sc) {
+                /* a private entry, it's published once it's complete. Nothing is evicted from the shared cache, so
+                 * once it's over its budget, glyphs are blitted from the sketch area */
+                i = sizeof(ssfn_cent_t) + sizeof(ssfn_glyph_t) - SSFN_DATA_MAX + sz;
+                if(!ctx->sc->max || SSFN_atomic_load(&ctx->sc->size) + i <= ctx->sc->max) {
+                    if(!(ce = (ssfn_cent_t*)SSFN_realloc(NULL, i))) return SSFN_ERR_ALLOC;
+                    ce->f = ctx->f; ce->u = unicode; ce->k = key; ce->s = i;
+                }
+            } else
+#endif
+            if(j < SSFN__CLASSES && (!ctx->cachemax || k <= ctx->cachemax)) {
+                ce = _ssfn_ca(ctx, ctx->f, unicode, key, sz);
+                if(!ce && !ctx->cr) return SSFN_ERR_ALLOC;
+            }
+            if(ce) {
+                tmp = (uint8_t*)(ce + 1);
+                ((ssfn_glyph_t*)tmp)->p = s ? w : ctx->g->p; ((ssfn_glyph_t*)tmp)->h = s ? H : ctx->g->h;
+                ((ssfn_glyph_t*)tmp)->o = ctx->g->o; ((ssfn_glyph_t*)tmp)->x = ctx->g->x;
+                ((ssfn_glyph_t*)tmp)->y = ctx->g->y; ((ssfn_glyph_t*)tmp)->a = ctx->g->a;
+                ((ssfn_glyph_t*)tmp)->d = ctx->g->d; ((ssfn_glyph_t*)tmp)->s = s;
+#ifndef SSFN_RASTER_COVERAGE
+                if(s) _ssfn_ds(ctx->g, s == 2 ? NULL : ((ssfn_glyph_t*)tmp)->data, ((ssfn_glyph_t*)tmp)->data +
+                    (s == 2 ? 0 : w * H), w, H, 0, 0, w, H, w); else
+#endif
+                for(i = 0, k = s == 2 ? sz : 0; i < sz; i++) ((ssfn_glyph_t*)tmp)->data[i] = ctx->g->data[k + i];
+#ifdef SSFN_SHAREDCACHE
+                if(ctx->sc && !(ce = _ssfn_sp(ctx->sc, ce))) return SSFN_ERR_ALLOC;
+#endif
+                ctx->g = (ssfn_glyph_t*)(ce + 1);
+                ps = s;
+            }
+        }
 #endif
 #ifdef SSFN_PROFILING
         gettimeofday(&tv1, NULL); tvd.tv_sec = tv1.tv_sec - tv0.tv_sec; tvd.tv_usec = tv1.tv_usec - tv0.tv_usec;
@@ -1241,98 +3006,75 @@ again:  if(p >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = p;
         n = ctx->size > 16 ? 2 : 1;
         if(w < n) w = n;
         if(s < n) s = n;
+        ctx->ow = w; ctx->oh = h; ctx->ps = ps;
         if(ctx->g->x) {
-            ctx->ox = ox = ((ctx->g->o * h + ctx->f->height - 1) / ctx->f->height) + (ctx->style & SSFN_STYLE_RTL ? w : 0);
+            ctx->ox = ox = ((ctx->g->o * h + ctx->f->height - 1) / ctx->f->height) +
+                (ctx->style & SSFN_STYLE_RTL ? w - (ph ? 1 : 0) : 0);
             ctx->oy = oy = (ctx->g->a * h + ctx->f->height - 1) / ctx->f->height;
         } else { ctx->ox = ox = w / 2; ctx->oy = oy = 0; }
         if(dst->ptr) {
             j = dst->w < 0 ? -dst->w : dst->w;
-            cs = dst->w < 0 ? 16 : 0;
+            fm = _ssfn_pf(dst, ctx->style); bp = fm == SSFN_PIXFMT_RGB565 ? 2 : (fm == SSFN_PIXFMT_GRAY8 ? 1 : 4);
+            cs = dst->w < 0 && fm != SSFN_PIXFMT_GRAY8 ? 16 : 0;
             cb = (h + 64) >> 6; uix = w > s ? w : s; uax = 0;
             n = (ctx->f->underline * h + ctx->f->height - 1) / ctx->f->height;
 #ifdef SSFN_DEBUGGLYPH
             printf("Scaling to w %d h %d (glyph %d %d, cache %d %d, font %d)\n",
                 w,h,ctx->rc->w,ctx->rc->h,ctx->g->p,ctx->g->h,ctx->f->height);
 #endif
-            fR = (dst->fg >> 16) & 0xFF; fG = (dst->fg >> 8) & 0xFF; fB = (dst->fg >> 0) & 0xFF; fA = (dst->fg >> 24) & 0xFF;
-            bR = (dst->bg >> 16) & 0xFF; bG = (dst->bg >> 8) & 0xFF; bB = (dst->bg >> 0) & 0xFF; O = 0xFF000000;
-            Op = (uint32_t*)(dst->ptr + dst->p * (dst->y - oy) + ((dst->x - ox) << 2));
-            for (y = 0; y < h && dst->y + y - oy < dst->h; y++, Op += dst->p >> 2) {
-                if(dst->y + y - oy < 0) continue;
-                y0 = (y << 8) * ctx->g->h / h; Y0 = y0 >> 8; y1 = ((y + 1) << 8) * ctx->g->h / h; Y1 = y1 >> 8; Ol = Op;
-                for (x = 0; x < w && dst->x + x - ox < j; x++, Ol++) {
-                    if(dst->x + x - ox < 0) continue;
-                    m = 0; sR = sG = sB = sA = 0;
-                    if(!dst->bg) {
-                        /* real linear frame buffers should be accessed only as uint32_t on 32 bit boundary */
-                        O = *Ol;
-                        bR = (O >> (16 - cs)) & 0xFF;
-                        bG = (O >> 8) & 0xFF;
-                        bB = (O >> cs) & 0xFF;
-                    }
-                    x0 = (x << 8) * ctx->g->p / w; X0 = x0 >> 8; x1 = ((x + 1) << 8) * ctx->g->p / w; X1 = x1 >> 8;
-                    for(ys = y0; ys < y1; ys += 256) {
-                        if(ys >> 8 == Y0) { yp = 256 - (ys & 0xFF); ys &= ~0xFF; if(yp > y1 - y0) yp = y1 - y0; }
-                        else if(ys >> 8 == Y1) yp = y1 & 0xFF; else yp = 256;
-                        X2 = (ys >> 8) * ctx->g->p;
-                        for(xs = x0; xs < x1; xs += 256) {
-                            if (xs >> 8 == X0) {
-                                k = 256 - (xs & 0xFF); xs &= ~0xFF; if(k > x1 - x0) k = x1 - x0; pc = k == 256 ? yp : (k * yp)>>8;
-                            } else
-                            if (xs >> 8 == X1) { k = x1 & 0xFF; pc = k == 256 ? yp : (k * yp) >> 8; }
-                            else pc = yp;
-                            m += pc;
-                            k = ctx->g->data[X2 + (xs >> 8)];
-                            if(k == 0xFF) {
-                                sB += bB * pc; sG += bG * pc; sR += bR * pc; sA += 255;
-                            } else {
-                                if(k == 0xFE || !ctx->f->cmap_offs) {
-                                    dB = fB; dG = fG; dR = fR; dA = fA;
-                                } else {
-                                    P = *((uint32_t*)((uint8_t*)ctx->f + ctx->f->cmap_offs + (k << 2)));
-                                    dR = (P >> 16) & 0xFF; dG = (P >> 8) & 0xFF; dB = (P >> 0) & 0xFF; dA = (P >> 24) & 0xFF;
-                                }
-                                if(dA == 255) {
-                                    sB += dB * pc; sG += dG * pc; sR += dR * pc; sA += dA * pc;
-                                } else {
-                                    sB += (dB * dA + bB * (255 - dA)) * pc / 255; sG += (dG * dA + bG * (255 - dA)) * pc / 255;
-                                    sR += (dR * dA + bR * (255 - dA)) * pc / 255; sA += dA * pc;
-                                }
-                            }
-                        }
-                    }
-                    if(m) { sR /= m; sG /= m; sB /= m; sA /= m; } else { sR >>= 8; sG >>= 8; sB >>= 8; sA >>= 8; }
-                    if(ctx->style & SSFN_STYLE_NOAA) sA = sA > 127 ? 255 : 0;
-                    if(sA > 15) {
-                        *Ol = (ctx->style & SSFN_STYLE_A ? O & 0xFF000000 : ((sA > 255 ? 255 : sA) << 24)) |
-                            ((sR > 255 ? 255 : sR) << (16 - cs)) | ((sG > 255 ? 255 : sG) << 8) | ((sB > 255 ? 255 : sB) << cs);
-                        if(y == n) { if(uix > x) { uix = x; } if(uax < x) { uax = x; } }
+            Op = dst->ptr + dst->p * (dst->y - oy) + (dst->x - ox) * bp;
+            /* the glyph is already at the requested size, just blend with its alpha plane */
+            if(ps) {
+                /* clip once, then blend all rows in one go */
+                x0 = ox - dst->x > 0 ? ox - dst->x : 0;
+                x1 = j - dst->x + ox < ctx->g->p ? j - dst->x + ox : ctx->g->p;
+                k = oy - dst->y > 0 ? oy - dst->y : 0;
+                l = dst->h - dst->y + oy < ctx->g->h ? dst->h - dst->y + oy : ctx->g->h;
+                if(x0 < x1 && k < l) {
+                    X2 = k * ctx->g->p + x0; uv[0] = x1; uv[1] = -1;
+                    /* without a color map the indices are never looked at, so alpha only glyphs pass their alpha */
+                    _ssfn_bl(Op + k * dst->p + x0 * bp, dst->p, fm, ctx->g->data + (ps == 2 ? 0 : ctx->g->p *
+                        ctx->g->h) + X2, ctx->g->data + X2, ctx->g->p, x1 - x0, l - k, dst->fg, dst->bg,
+                        ctx->f->cmap_offs && ps != 2 ? (uint8_t*)ctx->f + ctx->f->cmap_offs : NULL, cs, ctx->style, n - k, uv);
+                    if(uv[1] >= 0) { if(uix > x0 + uv[0]) { uix = x0 + uv[0]; } if(uax < x0 + uv[1]) { uax = x0 + uv[1]; } }
+                }
+            }
+#ifndef SSFN_RASTER_COVERAGE
+            /* not cached, scale down from the sketch area into dec (no longer needed once rasterized), a band of rows
+             * at a time. This is done to the same width and with the same blending as when caching, so the output does
+             * not depend on whether the glyph was cached */
+            if(!ps) {
+                w = ctx->g->p * h / ctx->g->h; if(!w && ctx->g->p) { w = 1; }
+                x0 = ox - dst->x > 0 ? ox - dst->x : 0;
+                x1 = j - dst->x + ox < w ? j - dst->x + ox : w;
+                k = oy - dst->y > 0 ? oy - dst->y : 0;
+                l = dst->h - dst->y + oy < h ? dst->h - dst->y + oy : h;
+                for(x = x0; x < x1 && k < l; x = X0) {
+                    X0 = x1 - x > 32768 ? x + 32768 : x1; m = 32768 / (X0 - x);
+                    for(y = k; y < l; y += m) {
+                        if(m > l - y) m = l - y;
+                        _ssfn_ds(ctx->g, dec, dec + 32768, w, h, x, y, X0 - x, m, X0 - x);
+                        uv[0] = X0; uv[1] = -1;
+                        _ssfn_bl(Op + y * dst->p + x * bp, dst->p, fm, dec + 32768, dec, X0 - x, X0 - x, m, dst->fg,
+                            dst->bg, ctx->f->cmap_offs ? (uint8_t*)ctx->f + ctx->f->cmap_offs : NULL, cs, ctx->style,
+                            n - y, uv);
+                        if(uv[1] >= 0) { if(uix > x + uv[0]) { uix = x + uv[0]; } if(uax < x + uv[1]) { uax = x + uv[1]; } }
                     }
                 }
             }
+#endif
             if(ctx->style & SSFN_STYLE_UNDERLINE) {
                 uix -= cb + 1; uax += cb + 2;
                 if(uax < uix) uax = uix + 1;
-                k = (w > s ? w : s);
-                Op = (uint32_t*)(dst->ptr + dst->p * (dst->y - oy + n) + ((dst->x - ox - 1) << 2));
-                for (y = n; y < n + cb && dst->y + y - oy < dst->h; y++, Op += dst->p >> 2) {
-                    if(dst->y + y - oy < 0) continue;
-                    for (Ol = Op, x = 0; x <= k && dst->x + x - ox < j; x++, Ol++) {
-                        if(dst->x + x - ox < 0 || (x > uix && x < uax)) continue;
-                        PUTPIXEL;
-                    }
+                /* in a run, ssfn_render_str() draws the lines, it only needs the gap */
+                if(ctx->ls) { ctx->ux0 = dst->x - ox - 1 + uix; ctx->ux1 = dst->x - ox - 1 + uax; } else {
+                    k = dst->x - ox - 1; uv[0] = k + uix; uv[1] = k + uax;
+                    _ssfn_hl(dst, ctx->style, k, k + (w > s ? w : s), dst->y - oy + n, cb, uv, 1);
                 }
             }
-            if(ctx->style & SSFN_STYLE_STHROUGH) {
-                n = (h >> 1); k = (w > s ? w : s) + 1;
-                Op = (uint32_t*)(dst->ptr + dst->p * (dst->y - oy + n) + ((dst->x - ox - 1) << 2));
-                for (y = n; y < n + cb && dst->y + y - oy < dst->h; y++, Op += dst->p >> 2) {
-                    if(dst->y + y - oy < 0) continue;
-                    for (Ol = Op, x = 0; x <= k && dst->x + x - ox < j; x++, Ol++) {
-                        if(dst->x + x - ox < 0) continue;
-                        PUTPIXEL;
-                    }
-                }
+            if((ctx->style & SSFN_STYLE_STHROUGH) && !ctx->ls) {
+                k = dst->x - ox - 1;
+                _ssfn_hl(dst, ctx->style, k, k + (w > s ? w : s) + 1, dst->y - oy + (h >> 1), cb, NULL, 0);
             }
 #ifdef SSFN_PROFILING
             gettimeofday(&tv1, NULL); tvd.tv_sec = tv1.tv_sec - tv0.tv_sec;tvd.tv_usec = tv1.tv_usec - tv0.tv_usec;
@@ -1341,42 +3083,67 @@ again:  if(p >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = p;
             memcpy(&tv0, &tv1, sizeof(struct timeval));
 #endif
         }
-        /* add advance and kerning */
+        if(ctx->lg) return ret;
+        /* add advance and kerning. With subpixel positioning the pen's x is kept in subpixels until the end, and the
+         * advance is rounded to the nearest instead of up, so that long lines don't drift */
+        sp = (ctx->style & SSFN_STYLE_SUBPIXEL) && ctx->g->x ? SSFN_SUBPREC : 0;
+        if(sp) {
+            dst->x = dst->x * (1 << sp) + (dst->fx & ((1 << sp) - 1));
+            s = (((ctx->g->x - ctx->g->o) * h << sp) + (ctx->f->height >> 1)) / ctx->f->height;
+        }
         ctx->ax = (ctx->style & SSFN_STYLE_RTL ? -s : s);
         dst->x += ctx->ax;
         dst->y += (ctx->g->y * h + ctx->f->height - 1) / ctx->f->height;
         ptr = (uint8_t*)str + ret;
-        if(!(ctx->style & SSFN_STYLE_NOKERN) && ctx->f->kerning_offs && _ssfn_c(ctx->f, (const char*)ptr, &i, &P) && P > 32) {
-            ptr = (uint8_t*)ctx->rc + sizeof(ssfn_chr_t);
-            /* check all kerning fragments, because we might have both vertical and horizontal kerning offsets */
-            for(n = 0; n < ctx->rc->n; n++) {
-                if(ptr[0] == 255 && ptr[1] == 255) { ptr += ctx->rc->t & 0x40 ? 6 : 5; continue; }
-                x = ptr[0];
-                if(ctx->rc->t & 0x40) { m = (ptr[5] << 24) | (ptr[4] << 16) | (ptr[3] << 8) | ptr[2]; ptr += 6; }
-                else { m = (ptr[4] << 16) | (ptr[3] << 8) | ptr[2]; ptr += 5; }
-                frg = (uint8_t*)ctx->f +  m;
-                if((frg[0] & 0xE0) == 0xC0) {
-                    k = (((frg[0] & 0x1F) << 8) | frg[1]) + 1; frg += 2;
-                    while(k--) {
-                        m = ((frg[2] & 0xF) << 16) | (frg[1] << 8) | frg[0];
-                        if(P >= (uint32_t)m && P <= (uint32_t)(((frg[5] & 0xF) << 16) | (frg[4] << 8) | frg[3])) {
-                            P -= m;
-                            m = ctx->f->kerning_offs + ((((frg[2] >> 4) & 0xF) << 24) | (((frg[5] >> 4) & 0xF) << 16) |
-                                (frg[7] << 8) | frg[6]);
-                            tmp = (uint8_t*)ctx->f + m;
-                            while(tmp < (uint8_t*)ctx->f + ctx->f->size - 4) {
-                                if((tmp[0] & 0x7F) < P) {
-                                    P -= (tmp[0] & 0x7F) + 1;
-                                    tmp += 2 + (tmp[0] & 0x80 ? 0 : tmp[0] & 0x7F);
-                                } else {
-                                    y = (int)((signed char)tmp[1 + ((tmp[0] & 0x80) ? 0 : P)]) * h / ctx->f->height;
-                                    if(x) dst->x += y; else dst->y += y;
-                                    break;
+        if(ctx->ls && nt == 1) {
+            /* the next glyph would be searched in this face first, so look it up only once for the whole run */
+            ctx->ls = (const char*)ptr; ctx->lf = fc; ctx->lc = _ssfn_c(fc, ctx->ls, &ctx->lr, &ctx->lu);
+            i = ctx->lr; P = ctx->lu; k = ctx->lc != NULL;
+        } else k = -1;
+        if(!(ctx->style & SSFN_STYLE_NOKERN) && ctx->f->kerning_offs && (k < 0 ? _ssfn_c(fc, (const char*)ptr, &i, &P)
+          != NULL : k) && P > 32) {
+#if defined(SSFN_KERNINDEX) && !defined(SSFN_MAXLINES) && !defined(SSFN_NOINDEX)
+            if(fc->kt) {
+                for(i = SSFN__KH(unicode, P) & (fc->nkt - 1); fc->kt[i * 2 + 1]; i = (i + 1) & (fc->nkt - 1))
+                    if((fc->kt[i * 2] & 0xFFFFFF) == unicode && (fc->kt[i * 2 + 1] & 0xFFFFFF) == P) {
+                        dst->x += (int)((signed char)(fc->kt[i * 2] >> 24)) * (h << sp) / ctx->f->height;
+                        dst->y += (int)((signed char)(fc->kt[i * 2 + 1] >> 24)) * h / ctx->f->height;
+                    }
+            } else
+#endif
+            {
+                ptr = (uint8_t*)ctx->rc + sizeof(ssfn_chr_t);
+                /* check all kerning fragments, because we might have both vertical and horizontal kerning offsets */
+                for(n = 0; n < ctx->rc->n; n++) {
+                    if(ptr[0] == 255 && ptr[1] == 255) { ptr += ctx->rc->t & 0x40 ? 6 : 5; continue; }
+                    x = ptr[0];
+                    if(ctx->rc->t & 0x40) { m = (ptr[5] << 24) | (ptr[4] << 16) | (ptr[3] << 8) | ptr[2]; ptr += 6; }
+                    else { m = (ptr[4] << 16) | (ptr[3] << 8) | ptr[2]; ptr += 5; }
+                    frg = (uint8_t*)ctx->f +  m;
+                    if((frg[0] & 0xE0) == 0xC0) {
+                        k = (((frg[0] & 0x1F) << 8) | frg[1]) + 1; frg += 2;
+                        while(k--) {
+                            m = ((frg[2] & 0xF) << 16) | (frg[1] << 8) | frg[0];
+                            if(P >= (uint32_t)m && P <= (uint32_t)(((frg[5] & 0xF) << 16) | (frg[4] << 8) | frg[3])) {
+                                O = P - m;
+                                m = ctx->f->kerning_offs + ((((frg[2] >> 4) & 0xF) << 24) | (((frg[5] >> 4) & 0xF) << 16) |
+                                    (frg[7] << 8) | frg[6]);
+                                tmp = (uint8_t*)ctx->f + m;
+                                while(fc->tr || tmp < (uint8_t*)ctx->f + ctx->f->size - 4) {
+                                    if((tmp[0] & 0x7F) < O) {
+                                        O -= (tmp[0] & 0x7F) + 1;
+                                        tmp += 2 + (tmp[0] & 0x80 ? 0 : tmp[0] & 0x7F);
+                                    } else {
+                                        y = (int)((signed char)tmp[1 + ((tmp[0] & 0x80) ? 0 : O)]) * (x ? h << sp : h) /
+                                            ctx->f->height;
+                                        if(x) dst->x += y; else dst->y += y;
+                                        break;
+                                    }
                                 }
+                                break;
                             }
-                            break;
+                            frg += 8;
                         }
-                        frg += 8;
                     }
                 }
             }
@@ -1386,6 +3153,7 @@ again:  if(p >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = p;
             ctx->kern += tvd.tv_sec * 1000000L + tvd.tv_usec;
 #endif
         }
+        if(sp) { ctx->ax >>= sp; dst->fx = dst->x & ((1 << sp) - 1); dst->x >>= sp; }
     }
     return ret;
 }
@@ -1404,30 +3172,312 @@ again:  if(p >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = p;
 int ssfn_bbox(ssfn_t *ctx, const char *str, int *w, int *h, int *left, int *top)
 {
     ssfn_buf_t buf;
-    int ret, f = 1, l = 0, t = 0;
+    int ret, f = 1, l = 0, t = 0, v = 0;
 
     if(!ctx || !str) return SSFN_ERR_INVINP;
     if(w) {*w = 0;} if(h) {*h = 0;} if(top) {*top = 0;} if(left) {*left = 0;}
     if(!*str) return SSFN_OK;
     SSFN_memset(&buf, 0, sizeof(ssfn_buf_t)); ctx->line = 0;
+    /* glyphs are looked up and kerned as usual, but only cached ones are used, the rest is not rasterized */
+    ctx->mo = 1;
     while((ret = ssfn_render(ctx, &buf, str))) {
-        if(ret < 0 || !ctx->g) return ret;
+        if(ret < 0) { ctx->mo = 0; return ret; }
+        /* control characters have no glyph */
+        if(!ctx->g) { str += ret; continue; }
         if(f) { f = 0; l = ctx->ox; buf.x += l; }
-        if(ctx->g->x) {
+        v = !ctx->g->x;
+        if(!v) {
             if(ctx->oy > t) t = ctx->oy;
         } else {
-            if(buf.w < ctx->g->p) buf.w = ctx->g->p;
+            if(buf.w < ctx->ow) buf.w = ctx->ow;
             buf.h += ctx->g->y ? ctx->g->y : ctx->g->h;
         }
         str += ret;
     }
+    ctx->mo = 0;
     if((ctx->style & SSFN_STYLE_ITALIC) && !(SSFN_TYPE_STYLE(ctx->f->type) & SSFN_STYLE_ITALIC))
         buf.x +=  ctx->size / SSFN_ITALIC_DIV - l;
-    if(ctx->g->x) { if(w) {*w = buf.x;} if(h) {*h = ctx->line;} if(left) {*left = l;} if(top) {*top = t;} }
+    if(!v) { if(w) {*w = buf.x + (buf.fx ? 1 : 0);} if(h) {*h = ctx->line;} if(left) {*left = l;} if(top) {*top = t;} }
     else { if(w) {*w = buf.w;} if(h) {*h = buf.y;} if(top) {*top = 0;} if(left) {*left = 0;} }
     return SSFN_OK;
 }
 
+/* store a wrapped line, if there's room for it */
+static void _ssfn_wl(ssfn_line_t *lines, int max, int n, int o, int e, int w, int h, int t)
+{
+    if(n >= max) return;
+    lines[n].offs = o; lines[n].len = e - o; lines[n].w = w < 0 ? -w : w; lines[n].h = h; lines[n].top = t;
+}
+
+/**
+ * Break text into lines no wider than width, in a single pass. Lines are broken at white space (which is dropped) and
+ * after hyphens, words longer than width are broken anywhere, and newlines always break. Uses the same metrics as
+ * ssfn_bbox(), so nothing is rasterized
+ *
+ * @param ctx rendering context
+ * @param str pointer to a zero terminated UTF-8 string
+ * @param width maximum line width in pixels
+ * @param lines returned lines (or NULL)
+ * @param max maximum number of lines
+ * @return error code or number of lines in str (could be more than max)
+ */
+int ssfn_wrap(ssfn_t *ctx, const char *str, int width, ssfn_line_t *lines, int max)
+{
+    ssfn_buf_t buf;
+    const char *s;
+    int ret = 0, n = 0, ls = 0, le = 0, lb = 0, xs = 0, xe = 0, xb = 0, x, p, sp = 0, hl = 0, tl = 0, hw = 0, tw = 0;
+
+    if(!ctx || !str || width < 1 || (max > 0 && !lines)) return SSFN_ERR_INVINP;
+    SSFN_memset(&buf, 0, sizeof(ssfn_buf_t));
+    /* ls, xs: line start, le, xe: line end at the last break opportunity, lb, xb: where the next line would start then.
+     * hl, tl: height and top of the line up to le, hw, tw: of the glyphs since */
+    ctx->mo = 1; ctx->ls = s = str; ctx->lc = NULL;
+    while(*s) {
+        p = (int)(s - str);
+        if(*s == '\r') { s++; continue; }
+        if(*s == '\n') {
+            if(!sp) { le = p; xe = buf.x; }
+            if(hw > hl) { hl = hw; } if(tw > tl) { tl = tw; }
+            _ssfn_wl(lines, max, n++, ls, le, xe - xs, hl ? hl : ctx->size, tl);
+            ls = le = lb = p + 1; xs = xe = xb = buf.x; hl = tl = hw = tw = sp = 0;
+            s++; continue;
+        }
+        x = buf.x;
+        if(*s == ' ' || *s == '\t') {
+            /* white space never breaks, it's dropped from the end of the line. Most fonts have no glyph for the tab,
+             * then it's as wide as a space */
+            if((ret = ssfn_render(ctx, &buf, s)) == SSFN_ERR_NOGLYPH && *s == '\t') ret = ssfn_render(ctx, &buf, " ");
+            if(ret < 0) break;
+            if(!sp) { le = p; xe = x; if(hw > hl) { hl = hw; } if(tw > tl) { tl = tw; } hw = tw = 0; }
+            lb = p + ret; xb = buf.x; sp = 1;
+        } else {
+            if((ret = ssfn_render(ctx, &buf, s)) < 0) break;
+            if(p > ls && (buf.x - xs > width || xs - buf.x > width)) {
+                if(le > ls) {
+                    /* break at the last opportunity */
+                    _ssfn_wl(lines, max, n++, ls, le, xe - xs, hl, tl);
+                    ls = le = lb; xs = xe = xb; hl = tl = 0;
+                }
+                if(p > ls && (buf.x - xs > width || xs - buf.x > width)) {
+                    /* the word alone is too long, break it right here */
+                    if(hw > hl) { hl = hw; } if(tw > tl) { tl = tw; }
+                    _ssfn_wl(lines, max, n++, ls, p, x - xs, hl, tl);
+                    ls = le = lb = p; xs = xe = xb = x; hl = tl = hw = tw = 0;
+                }
+            }
+            if(ctx->oh > hw) hw = ctx->oh;
+            if(ctx->oy > tw) tw = ctx->oy;
+            sp = 0;
+            if(*s == '-') {
+                le = lb = p + ret; xe = xb = buf.x;
+                if(hw > hl) { hl = hw; } if(tw > tl) { tl = tw; } hw = tw = 0;
+            }
+        }
+        s += ret;
+    }
+    ctx->mo = 0; ctx->ls = NULL; ctx->lc = NULL;
+    if(ret < 0) return ret;
+    if(!sp) { le = (int)(s - str); xe = buf.x; }
+    if(hw > hl) { hl = hw; } if(tw > tl) { tl = tw; }
+    _ssfn_wl(lines, max, n++, ls, le, xe - xs, hl ? hl : ctx->size, tl);
+    return n;
+}
+
+/**
+ * Render a glyph to an 8 bit alpha mask, without blending
+ *
+ * @param ctx rendering context
+ * @param str pointer to an UTF-8 string
+ * @param mask alpha mask, at least m->w x m->h bytes (or NULL)
+ * @param idx color index plane, same size (or NULL)
+ * @param pitch bytes per line in mask and idx
+ * @param m returned metrics (or NULL)
+ * @return error code or number of bytes consumed
+ */
+int ssfn_render_mask(ssfn_t *ctx, const char *str, uint8_t *mask, uint8_t *idx, int pitch, ssfn_metrics_t *m)
+{
+    ssfn_buf_t buf;
+    const ssfn_glyph_t *g;
+    const uint8_t *a;
+    int ret, i, x, y, w;
+
+    if(!ctx || !str || ((mask || idx) && pitch < 1)) return SSFN_ERR_INVINP;
+    SSFN_memset(&buf, 0, sizeof(ssfn_buf_t));
+    if(m) SSFN_memset(m, 0, sizeof(ssfn_metrics_t));
+    if((ret = ssfn_render(ctx, &buf, str)) <= 0) return ret;
+    /* control characters only move the pen, they have no mask */
+    if(!ctx->g) { if(m) { m->x = buf.x; m->y = buf.y; } return ret; }
+    if(m) { m->w = ctx->ow; m->h = ctx->oh; m->left = ctx->ox; m->top = ctx->oy; m->x = buf.x; m->y = buf.y; }
+    if(!mask && !idx) return ret;
+    g = ctx->g;
+    /* scaled to the same width as when cached, the rest of the mask is empty */
+    w = ctx->ps ? g->p : g->p * ctx->oh / g->h; if(!w && g->p) { w = 1; }
+    if(w > ctx->ow) w = ctx->ow;
+    if(ctx->ps) {
+        /* already at the requested size, just copy the planes. Alpha only glyphs have the foreground color wherever
+         * they cover a pixel */
+        a = g->data + (ctx->ps == 2 ? 0 : g->p * g->h);
+        for(y = 0; y < ctx->oh; y++)
+            for(x = 0; x < w; x++) {
+                i = y * g->p + x;
+                if(mask) mask[y * pitch + x] = a[i];
+                if(idx) idx[y * pitch + x] = ctx->ps != 2 ? g->data[i] : (a[i] ? 0xFE : 0xFF);
+            }
+    }
+#ifndef SSFN_RASTER_COVERAGE
+    else _ssfn_ds(g, idx, mask, w, ctx->oh, 0, 0, w, ctx->oh, pitch);
+#endif
+    for(y = 0; y < ctx->oh; y++)
+        for(x = 0; x < ctx->ow; x++)
+            if(x >= w) {
+                if(mask) mask[y * pitch + x] = 0;
+                if(idx) idx[y * pitch + x] = 0xFF;
+            } else if(mask && (ctx->style & SSFN_STYLE_NOAA)) mask[y * pitch + x] = mask[y * pitch + x] > 127 ? 255 : 0;
+    return ret;
+}
+
+/* draw the underline and strike-through of a run, l is x0, x1, underline row, strike-through row and thickness */
+static void _ssfn_ul(const ssfn_buf_t *dst, int style, const int *l, int *g, int ng)
+{
+    int i, j;
+
+    if(style & SSFN_STYLE_UNDERLINE) {
+        /* right-to-left runs collect the gaps backwards */
+        if(style & SSFN_STYLE_RTL)
+            for(i = 0; i < ng / 2; i++) {
+                j = g[i * 2]; g[i * 2] = g[(ng - 1 - i) * 2]; g[(ng - 1 - i) * 2] = j;
+                j = g[i * 2 + 1]; g[i * 2 + 1] = g[(ng - 1 - i) * 2 + 1]; g[(ng - 1 - i) * 2 + 1] = j;
+            }
+        _ssfn_hl(dst, style, l[0], l[1], l[2], l[4], g, ng);
+    }
+    if(style & SSFN_STYLE_STHROUGH)
+        _ssfn_hl(dst, style, l[0], l[1] + 1, l[3], l[4], NULL, 0);
+}
+
+/**
+ * Render a run of glyphs in one pass. Like calling ssfn_render() for each glyph, but the next glyph is looked up only
+ * once when possible (it's needed for kerning anyway), and underline and strike-through are drawn once per run
+ *
+ * @param ctx rendering context
+ * @param dst destination buffer
+ * @param str pointer to a zero terminated UTF-8 string
+ * @param len maximum number of bytes to render, or -1 for the whole string. Glyphs that don't fit are not rendered
+ * @param flags additional SSFN_STYLE_* flags for this run
+ * @return error code or number of bytes consumed
+ */
+int ssfn_render_str(ssfn_t *ctx, ssfn_buf_t *dst, const char *str, int len, int flags)
+{
+    const char *s;
+    int ret = 0, st, x, y, k, h, nl = 0, ng = 0, cl = 0, lm = 0, l[5], g[2 * 64];
+
+    if(!ctx || !dst || !str) return SSFN_ERR_INVINP;
+    /* the same styles as ssfn_select() accepts */
+    if((flags & ~0x1FFFF)) return SSFN_ERR_BADSTYLE;
+    st = ctx->style; ctx->style |= flags;
+    ctx->ls = s = str; ctx->lc = NULL; ctx->le = len < 0 ? NULL : str + len;
+    while(*s && (len < 0 || s - str < len)) {
+        if(*s == '\r' || *s == '\n') {
+            if(nl) { _ssfn_ul(dst, ctx->style, l, g, ng); nl = ng = cl = 0; }
+            if((ret = ssfn_render(ctx, dst, s)) < 0) break;
+            s += ret; continue;
+        }
+        x = dst->x; y = dst->y;
+        if((ret = ssfn_render(ctx, dst, s)) == SSFN_ERR_NOGLYPH && *s == '\t') {
+            /* most fonts have no glyph for the tab, then it's drawn as a space, just like ssfn_wrap() measures it */
+            ctx->le = NULL; ret = ssfn_render(ctx, dst, " "); ctx->le = len < 0 ? NULL : str + len;
+        }
+        if(ret <= 0) break;
+        s += ret;
+        if(!dst->ptr || !(ctx->style & (SSFN_STYLE_UNDERLINE | SSFN_STYLE_STHROUGH))) continue;
+        k = ctx->ax < 0 ? -ctx->ax : ctx->ax; if(k < ctx->ow) k = ctx->ow;
+        x -= ctx->ox + 1; h = ctx->oh;
+        if(!nl) {
+            l[0] = x; l[1] = x + k; l[4] = (h + 64) >> 6;
+            l[2] = y - ctx->oy + (ctx->f->underline * h + ctx->f->height - 1) / ctx->f->height;
+            l[3] = y - ctx->oy + (h >> 1);
+            /* don't blend pixels twice where a flushed run ends */
+            if(cl) { if(ctx->style & SSFN_STYLE_RTL) { if(l[1] > lm) l[1] = lm; } else if(l[0] < lm) l[0] = lm; }
+            nl = 1;
+        } else {
+            if(x < l[0]) l[0] = x;
+            if(x + k > l[1]) l[1] = x + k;
+        }
+        if(ctx->style & SSFN_STYLE_UNDERLINE) { g[ng * 2] = ctx->ux0; g[ng * 2 + 1] = ctx->ux1; ng++; }
+        if(ng == 64) {
+            _ssfn_ul(dst, ctx->style, l, g, ng);
+            lm = ctx->style & SSFN_STYLE_RTL ? l[0] - 1 : l[1] + 1; nl = ng = 0; cl = 1;
+        }
+    }
+    if(nl) _ssfn_ul(dst, ctx->style, l, g, ng);
+    ctx->ls = NULL; ctx->lc = NULL; ctx->le = NULL; ctx->style = st;
+    return ret < 0 ? ret : (int)(s - str);
+}
+
+/**
+ * Lay out a string into positioned glyphs, which then can be drawn many times with ssfn_render_layout() without any
+ * lookups. The glyphs are rasterized into the cache, but nothing is drawn
+ *
+ * @param ctx rendering context
+ * @param str pointer to a zero terminated UTF-8 string
+ * @param len maximum number of bytes to lay out, or -1 for the whole string. Glyphs that don't fit are left out
+ * @param run returned positioned glyphs (or NULL)
+ * @param max maximum number of glyphs in run
+ * @return error code or the number of glyphs in str (could be more than max)
+ */
+int ssfn_layout(ssfn_t *ctx, const char *str, int len, ssfn_gpos_t *run, int max)
+{
+    ssfn_buf_t buf;
+    const char *s;
+    int ret = 0, n = 0, x, y, sp = ctx && (ctx->style & SSFN_STYLE_SUBPIXEL) ? SSFN_SUBPREC : 0;
+
+    if(!ctx || !str || (max > 0 && !run)) return SSFN_ERR_INVINP;
+    SSFN_memset(&buf, 0, sizeof(ssfn_buf_t));
+    /* this is a run too, so the next glyph is looked up only once */
+    ctx->ls = s = str; ctx->lc = NULL; ctx->le = len < 0 ? NULL : str + len;
+    while(*s && (len < 0 || s - str < len)) {
+        x = buf.x * (1 << sp) + buf.fx; y = buf.y;
+        if((ret = ssfn_render(ctx, &buf, s)) <= 0) break;
+        if(*s != '\r' && *s != '\n') {
+            if(n < max) {
+                run[n].f = ctx->f; run[n].c = ctx->rc; run[n].u = ctx->cu; run[n].k = ctx->ck;
+                run[n].x = x; run[n].y = y; run[n].ax = buf.x * (1 << sp) + buf.fx - x; run[n].ay = buf.y - y;
+            }
+            n++;
+        }
+        s += ret;
+    }
+    ctx->ls = NULL; ctx->lc = NULL; ctx->le = NULL;
+    return ret < 0 ? ret : n;
+}
+
+/**
+ * Draw glyphs laid out by ssfn_layout(). The context must have the same size and style selected as it had when the
+ * run was laid out, and no fonts should be loaded since
+ *
+ * @param ctx rendering context
+ * @param dst destination buffer, the run is drawn at its x and y (which are not changed)
+ * @param run positioned glyphs
+ * @param num number of glyphs in run
+ * @return error code
+ */
+int ssfn_render_layout(ssfn_t *ctx, ssfn_buf_t *dst, const ssfn_gpos_t *run, int num)
+{
+    int i, x, y, f, sp, ret = SSFN_OK;
+
+    if(!ctx || !dst || (num > 0 && !run)) return SSFN_ERR_INVINP;
+    sp = ctx->style & SSFN_STYLE_SUBPIXEL ? SSFN_SUBPREC : 0;
+    x = dst->x; y = dst->y; f = dst->fx;
+    for(i = 0; i < num && ret >= 0; i++) {
+        dst->x = x * (1 << sp) + (sp ? f : 0) + run[i].x; dst->y = y + run[i].y;
+        if(sp) { dst->fx = dst->x & ((1 << sp) - 1); dst->x >>= sp; }
+        ctx->lg = &run[i];
+        ret = ssfn_render(ctx, dst, "");
+    }
+    ctx->lg = NULL;
+    dst->x = x; dst->y = y; dst->fx = f;
+    return ret < 0 ? ret : SSFN_OK;
+}
+
 /**
  * Render text to a newly allocated pixel buffer
  *
@@ -1570,16 +3620,36 @@ namespace SSFN {
         public:
             int Load(const std::string &data);
             int Load(const void *data, int len);
+            int LoadInto(const void *data, void *buf, int size);
+            int Share(const Font *src);
+#if defined(SSFN_LOADFILE) && !defined(SSFN_MAXLINES)
+            int LoadFile(const char *path);
+#endif
             int Select(int family, const std::string &name, int style, int size);
             int Select(int family, const char *name, int style, int size);
             int Render(ssfn_buf_t *dst, const std::string &str);
             int Render(ssfn_buf_t *dst, const char *str);
             int BBox(const std::string &str, int *w, int *h, int *left, int *top);
             int BBox(const char *str, int *w, int *h, int *left, int *top);
+            int RenderMask(const std::string &str, uint8_t *mask, uint8_t *idx, int pitch, ssfn_metrics_t *m);
+            int RenderMask(const char *str, uint8_t *mask, uint8_t *idx, int pitch, ssfn_metrics_t *m);
+            int RenderStr(ssfn_buf_t *dst, const std::string &str, int flags);
+            int RenderStr(ssfn_buf_t *dst, const char *str, int len, int flags);
+            int Layout(const std::string &str, ssfn_gpos_t *run, int max);
+            int Layout(const char *str, int len, ssfn_gpos_t *run, int max);
+            int RenderLayout(ssfn_buf_t *dst, const ssfn_gpos_t *run, int num);
+            int Wrap(const std::string &str, int width, ssfn_line_t *lines, int max);
+            int Wrap(const char *str, int width, ssfn_line_t *lines, int max);
             ssfn_buf_t *Text(const std::string &str, unsigned int fg);
             ssfn_buf_t *Text(const char *str, unsigned int fg);
             int LineHeight();
             int Mem();
+            int CacheLimit(int size);
+            int Allocator(const ssfn_alloc_t *al);
+            int CacheRegion(void *buf, int size);
+#ifdef SSFN_SHAREDCACHE
+            int ShareCache(ssfn_cache_t *cache);
+#endif
             const std::string ErrorStr(int err);
     };
 #else
@@ -1594,6 +3664,11 @@ namespace SSFN {
         public:
             int Load(const std::string &data) { return ssfn_load(&this->ctx,reinterpret_cast<const void*>(data.data())); }
             int Load(const void *data) { return ssfn_load(&this->ctx, data); }
+            int LoadInto(const void *data, void *buf, int size) { return ssfn_load_into(&this->ctx, data, buf, size); }
+            int Share(const Font *src) { return ssfn_share(&this->ctx, src ? &src->ctx : NULL); }
+#if defined(SSFN_LOADFILE) && !defined(SSFN_MAXLINES)
+            int LoadFile(const char *path) { return ssfn_load_file(&this->ctx, path); }
+#endif
             int Select(int family, const std::string &name, int style, int size)
                 { return ssfn_select(&this->ctx, family, (char*)name.data(), style, size); }
             int Select(int family, char *name, int style, int size) { return ssfn_select(&this->ctx,family,name,style,size); }
@@ -1602,11 +3677,35 @@ namespace SSFN {
             int BBox(const std::string &str, int *w, int *h, int *left, int *top)
                 { return ssfn_bbox(&this->ctx, (const char *)str.data(), w, h, left, top); }
             int BBox(const char *str, int *w, int *h, int *left, int *top) { return ssfn_bbox(&this->ctx,str,w,h,left,top); }
+            int RenderMask(const std::string &str, uint8_t *mask, uint8_t *idx, int pitch, ssfn_metrics_t *m)
+                { return ssfn_render_mask(&this->ctx, (const char *)str.data(), mask, idx, pitch, m); }
+            int RenderMask(const char *str, uint8_t *mask, uint8_t *idx, int pitch, ssfn_metrics_t *m)
+                { return ssfn_render_mask(&this->ctx, str, mask, idx, pitch, m); }
+            int RenderStr(ssfn_buf_t *dst, const std::string &str, int flags)
+                { return ssfn_render_str(&this->ctx, dst, (const char *)str.c_str(), (int)str.size(), flags); }
+            int RenderStr(ssfn_buf_t *dst, const char *str, int len, int flags)
+                { return ssfn_render_str(&this->ctx, dst, str, len, flags); }
+            int Layout(const std::string &str, ssfn_gpos_t *run, int max)
+                { return ssfn_layout(&this->ctx, (const char *)str.c_str(), (int)str.size(), run, max); }
+            int Layout(const char *str, int len, ssfn_gpos_t *run, int max)
+                { return ssfn_layout(&this->ctx, str, len, run, max); }
+            int RenderLayout(ssfn_buf_t *dst, const ssfn_gpos_t *run, int num)
+                { return ssfn_render_layout(&this->ctx, dst, run, num); }
+            int Wrap(const std::string &str, int width, ssfn_line_t *lines, int max)
+                { return ssfn_wrap(&this->ctx, (const char *)str.c_str(), width, lines, max); }
+            int Wrap(const char *str, int width, ssfn_line_t *lines, int max)
+                { return ssfn_wrap(&this->ctx, str, width, lines, max); }
             ssfn_buf_t *Text(const std::string &str, unsigned int fg)
                 { return ssfn_text(&this->ctx,(const char*)str.data(), fg); }
             ssfn_buf_t *Text(const char *str, unsigned int fg) { return ssfn_text(&this->ctx, str, fg); }
             int LineHeight() { return this->ctx.line ? this->ctx.line : this->ctx.size; }
             int Mem() { return ssfn_mem(&this->ctx); }
+            int CacheLimit(int size) { return ssfn_cachelimit(&this->ctx, size); }
+            int Allocator(const ssfn_alloc_t *al) { return ssfn_allocator(&this->ctx, al); }
+            int CacheRegion(void *buf, int size) { return ssfn_cacheregion(&this->ctx, buf, size); }
+#ifdef SSFN_SHAREDCACHE
+            int ShareCache(ssfn_cache_t *cache) { return ssfn_sharecache(&this->ctx, cache); }
+#endif
             const std::string ErrorStr(int err) { return std::string(ssfn_error(err)); }
     };
 #endif